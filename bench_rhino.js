@@ -0,0 +1,42 @@
+load("sprintf-0.6.js")
+load("jsmat/matrix.js");
+load("hp15c.js");
+load("bench.js");
+
+function alert(s) {
+    print(s);
+}
+
+function setTimeout(fn, delay) {
+    return null;
+}
+
+function clearTimeout(t) {
+}
+
+function setInterval(fn, delay) {
+    return null;
+}
+
+function clearInterval(t) {
+}
+
+function bench_now() {
+    return java.lang.System.nanoTime() / 1e6;
+}
+
+console = {
+    log: function(s) {
+    }
+};
+
+window = {
+    console: console
+};
+
+// usage: java -jar js.jar ../bench_rhino.js [--warmup=N] [--reps=N]
+//        [--scale=F] [--filter=REGEX] [--baseline=FILE] [--threshold=PCT]
+print(bench_main(arguments));
+if (BenchRegressions > 0) {
+    quit(1);
+}
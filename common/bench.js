@@ -0,0 +1,591 @@
+// Benchmark suite for the calculator engine.
+//
+// Every benchmark runs a fixed number of iterations per repetition. The
+// first BenchOptions.warmup repetitions are thrown away and the rest are
+// summarised as nanoseconds per iteration. bench_main() returns the report
+// as JSON with a fixed key order and no timestamps, so that reports from
+// two builds can be diffed or compared with --baseline.
+//
+// The host must provide bench_now() (milliseconds, fractional if the host
+// has a better clock than Date) and readFile() if --baseline is used.
+
+var BenchOptions = {
+    warmup: 2,
+    reps: 7,
+    scale: 1,
+    filter: null,
+    baseline: null,
+    threshold: 5
+};
+var BenchRegressions = 0;
+
+function Benchmark(name, iterations, unit, setup, fn) {
+    this.name = name;
+    this.iterations = iterations;
+    this.unit = unit;
+    this.setup = setup;
+    this.fn = fn;
+    this.batch = 1;
+    this.steps = 0;
+}
+
+var Benchmarks = [];
+
+function bench_now_default() {
+    return new Date().getTime();
+}
+
+function bench_reset() {
+    Stack = [0, 0, 0, 0];
+    StackI = [0, 0, 0, 0];
+    LastX = 0;
+    LastXI = 0;
+    for (var i = 0; i < Reg.length; i++) {
+        Reg[i] = 0;
+    }
+    Reg.I = 0;
+    Flags = [false, false, false, false, false, false, false, false, false, false];
+    DigitEntry = false;
+    StackLift = false;
+    Shift = 0;
+    Prefix = null;
+    User = false;
+    Prgm = false;
+    Program = [null];
+    PC = 0;
+    Running = false;
+    ReturnStack = [];
+    Result = 0;
+    DisplayMode = 1;
+    DisplayDigits = 4;
+    FullCircle = 360;
+    TrigFactor = Math.PI / 180;
+    g_Matrix = [new Mat(0, 0),
+                new Mat(0, 0),
+                new Mat(0, 0),
+                new Mat(0, 0),
+                new Mat(0, 0)];
+}
+
+// Press each key in turn and run any program that a key starts, the same
+// way run_tests() does, so that no timer is involved.
+function bench_keys(keys) {
+    for (var i = 0; i < keys.length; i++) {
+        key(keys.charAt(i), true);
+        while (Running) {
+            if (RunTimer !== null) {
+                clearTimeout(RunTimer);
+                RunTimer = null;
+            }
+            run_lines(RunLines);
+        }
+    }
+}
+
+function bench_stack(x, y, z, t) {
+    Stack[0] = x;
+    Stack[1] = y;
+    Stack[2] = z;
+    Stack[3] = t;
+    StackI[0] = StackI[1] = StackI[2] = StackI[3] = 0;
+    DigitEntry = false;
+    StackLift = true;
+}
+
+// Opcodes grouped by the OpcodeInfo family they belong to. Each entry is
+// [name, keys, x, y] and the stack is reset to x, y, 1, 2 before every
+// iteration. Names under "complex." run with flag 8 set and a nonzero
+// imaginary part.
+var BenchOpcodes = [
+    ["entry.digits",      "123.45",   0,    0],
+    ["entry.eex",         "1.5e_7",   0,    0],
+    ["entry.chs",         "_",        2.5,  0],
+    ["arith.add",         "+",        3,    7],
+    ["arith.sub",         "-",        3,    7],
+    ["arith.mul",         "*",        3,    7],
+    ["arith.div",         "/",        3,    7],
+    ["arith.pct",         "%",        3,    7],
+    ["arith.dpct",        "g\\",      3,    7],
+    ["math.sqrt",         "q",        2,    0],
+    ["math.x2",           "@",        2,    0],
+    ["math.ex",           "E",        0.5,  0],
+    ["math.ln",           "l",        2,    0],
+    ["math.10x",          ")",        0.5,  0],
+    ["math.log",          "g)",       2,    0],
+    ["math.yx",           "^",        0.5,  2],
+    ["math.1x",           "\\",       2,    0],
+    ["math.abs",          "a",        -2,   0],
+    ["math.int",          "i",        2.5,  0],
+    ["math.frac",         "fS",       2.5,  0],
+    ["math.fact_int",     "!",        10,   0],
+    ["math.fact_gamma",   "!",        4.5,  0],
+    ["math.pyx",          "f+",       3,    7],
+    ["math.cyx",          "g+",       3,    7],
+    ["trig.sin",          "s",        30,   0],
+    ["trig.cos",          "c",        60,   0],
+    ["trig.tan",          "t",        45,   0],
+    ["trig.sin_exact",    "s",        180,  0],
+    ["trig.asin",         "gs",       0.5,  0],
+    ["trig.acos",         "gc",       0.5,  0],
+    ["trig.atan",         "gt",       1,    0],
+    ["hyp.sinh",          "fGs",      0.5,  0],
+    ["hyp.cosh",          "fGc",      0.5,  0],
+    ["hyp.tanh",          "fGt",      0.5,  0],
+    ["hyp.asinh",         "gGs",      0.5,  0],
+    ["hyp.acosh",         "gGc",      1.5,  0],
+    ["hyp.atanh",         "gGt",      0.5,  0],
+    ["conv.to_r",         "f1",       2,    30],
+    ["conv.to_p",         "g1",       2,    3],
+    ["conv.to_hms",       "f2",       1.2345, 0],
+    ["conv.to_h",         "g2",       1.2345, 0],
+    ["conv.to_rad",       "f3",       45,   0],
+    ["conv.to_deg",       "g3",       1,    0],
+    ["stack.enter",       "\r",       3,    7],
+    ["stack.roll",        "r",        3,    7],
+    ["stack.rollup",      "gr",       3,    7],
+    ["stack.xy",          "x",        3,    7],
+    ["stack.lastx",       "L",        3,    7],
+    ["stack.clx",         "g\b",      3,    7],
+    ["stack.pi",          "p",        3,    7],
+    ["reg.sto",           "S1",       3,    7],
+    ["reg.rcl",           "R1",       3,    7],
+    ["reg.sto_add",       "S+1",      3,    7],
+    ["reg.rcl_mul",       "R*1",      3,    7],
+    ["reg.sto_i",         "St",       3,    7],
+    ["reg.rcl_index",     "Rc",       3,    7],
+    ["reg.xchg",          "f41",      3,    7],
+    ["stat.sum",          ";",        3,    7],
+    ["stat.mean",         "g0",       3,    7],
+    ["stat.lr",           "f;",       3,    7],
+    ["complex.add",       "+",        3,    7],
+    ["complex.mul",       "*",        3,    7],
+    ["complex.div",       "/",        3,    7],
+    ["complex.sqrt",      "q",        3,    7],
+    ["complex.ln",        "l",        3,    7],
+    ["complex.sin",       "s",        0.5,  7],
+    ["complex.sinh",      "fGs",      0.5,  7],
+    ["complex.yx",        "^",        0.5,  2],
+    ["complex.re_im",     "f-",       3,    7]
+];
+
+// Stored programs, as keystrokes entered in program mode, and the keys
+// that run them. Registers are set from "regs" before every run.
+var BenchPrograms = [
+    ["loop.dse",         "fT1f51G1gU",                   "U1",     {1: 200}],
+    ["loop.isg",         "fT2f62G2gU",                   "U2",     {2: 0.199}],
+    ["loop.arith",       "fT3R4R5*S+6f53G3gU",           "U3",     {3: 100, 4: 1.5, 5: 2.5}],
+    ["loop.test",        "fT4R7fT.41-g-0G.4gU",          "U4",     {7: 200}],
+    ["gsb.nested",       "fT5U6f55G5gUfT6U7gUfT7R9+gU",  "U5",     {5: 100, 9: 1}],
+    ["solve",            "fTq20/_E_1+5000*x200*-gU",     "5\r6f/q", {}],
+    ["integrate",        "fT0scgU",                      "g80\rpf*0", {}],
+    ["map.arith",        "fTEgq3*1+gU",                  "fe)8\r8fsqR_qf_E", {}],
+    ["map.branch",       "fTEg*G0\\gUfT0gU",             "fe)8\r8fsqR_qf_E", {}]
+];
+
+function bench_opcode(entry) {
+    var complex = entry[0].indexOf("complex.") === 0;
+    var setup = function() {
+        bench_stack(entry[2], entry[3], 1, 2);
+        if (complex) {
+            Flags[8] = true;
+            StackI[0] = 0.25;
+            StackI[1] = -0.5;
+        }
+        Reg[1] = 1.5;
+        Reg.I = 1;
+        Reg[2] = 4; Reg[3] = 10; Reg[4] = 30; Reg[5] = 20; Reg[6] = 120; Reg[7] = 55;
+    };
+    return new Benchmark("opcode." + entry[0], 1000, "op", setup, function() {
+        bench_keys(entry[1]);
+    });
+}
+
+function bench_program(entry) {
+    var loaded = function() {
+        bench_reset();
+        bench_keys("gPfr" + entry[1] + "gP");
+    };
+    var setup = function() {
+        bench_stack(0, 0, 0, 0);
+        for (var r in entry[3]) {
+            Reg[r] = entry[3][r];
+        }
+    };
+    var b = new Benchmark("program." + entry[0], 20, "run", setup, function() {
+        bench_keys(entry[2]);
+    });
+    b.prepare = loaded;
+    return b;
+}
+
+// Special functions, script (ScriptSpecial in hp15c.js) against native
+// (Native, when the host provides it). Each entry is [name, arguments,
+// exact results] and the exact results, where given, are used to report
+// the error of each version as well as the difference between them.
+var BenchSpecial = [
+    ["factorial", [-10.5, -3.3, -0.5, 0.5, 1.5, 4.5, 10, 20.2, 69],
+                  [2.7721279115751013e-06, -1.447107394255918, 1.7724538509055159, 0.886226925452758,
+                   1.3293403881791372, 52.34277778455352, 3628800, 4.455600509352974e+18, 1.711224524281413e+98]],
+    ["sinh", [-20, -1, -0.001, 0.5, 3, 20]],
+    ["cosh", [-20, -1, -0.001, 0.5, 3, 20]],
+    ["tanh", [-5, -1, -0.001, 0.5, 3, 5]],
+    ["asinh", [-20, -1, -0.001, 0.5, 3, 20]],
+    ["acosh", [1.001, 1.5, 3, 20, 1000]],
+    ["atanh", [-0.99, -0.5, -0.001, 0.25, 0.9]],
+    ["sin_drg_mode", [30, 90, 150, 180, 210, 270, 450, -90, 3600030], [0.5, 1, 0.5, 0, -0.5, -1, 1, -1, 0.5]],
+    ["cos_drg_mode", [60, 90, 120, 180, 240, 270, 360, -180, 3600060], [0.5, 0, -0.5, -1, -0.5, 0, 1, -1, 0.5]],
+    ["tan_drg_mode", [45, 135, 180, 225, 315, 360, -45, 3600045], [1, -1, 0, 1, -1, 0, -1, 1]]
+];
+var BenchSpecialComplex = ["sin", "cos", "tan", "sinh", "cosh", "tanh",
+                           "asin", "acos", "atan", "asinh", "acosh", "atanh"];
+
+function bench_special_args() {
+    return [new Complex(0.5, 0.25), new Complex(-1.5, 2), new Complex(3, -0.5), new Complex(0, 0.75)];
+}
+
+// Complex numbers whose methods are the script versions even when the
+// native ones are available.
+function bench_special_script_args() {
+    var saved = NativeComplex;
+    NativeComplex = null;
+    try {
+        return bench_special_args();
+    } finally {
+        NativeComplex = saved;
+    }
+}
+
+function bench_special() {
+    var r = [];
+    var add = function(name, args, fn) {
+        var b = new Benchmark("special." + name, 2000, "call", function() {}, function() {
+            for (var i = 0; i < args.length; i++) {
+                fn(args[i]);
+            }
+        });
+        b.batch = args.length;
+        r.push(b);
+    };
+    var i;
+    for (i = 0; i < BenchSpecial.length; i++) {
+        var name = BenchSpecial[i][0];
+        add(name + ".script", BenchSpecial[i][1], ScriptSpecial[name]);
+        if (typeof(Native) === "object") {
+            add(name + ".native", BenchSpecial[i][1], Native[name]);
+        }
+    }
+    for (i = 0; i < BenchSpecialComplex.length; i++) {
+        var method = BenchSpecialComplex[i];
+        add("complex." + method + ".script", bench_special_script_args(), bench_method(method));
+        if (NativeComplex !== null) {
+            add("complex." + method + ".native", bench_special_args(), bench_method(method));
+        }
+    }
+    return r;
+}
+
+function bench_method(method) {
+    return function(z) {
+        return z[method]();
+    };
+}
+
+function bench_rel_err(r, e) {
+    if (r === e) {
+        return 0;
+    }
+    if (e instanceof Complex || r instanceof Complex) {
+        r = r instanceof Complex ? r : new Complex(r, 0);
+        e = e instanceof Complex ? e : new Complex(e, 0);
+        return Math.max(bench_rel_err(r.re, e.re), bench_rel_err(r.im, e.im));
+    }
+    return Math.abs(e) > 1e-300 ? Math.abs(r / e - 1) : Math.abs(r - e);
+}
+
+// Largest relative error of each function over its arguments; a difference
+// between two versions is given as the error of one relative to the other.
+function bench_accuracy() {
+    var r = [];
+    var native = typeof(Native) === "object";
+    var i, j;
+    for (i = 0; i < BenchSpecial.length; i++) {
+        var name = BenchSpecial[i][0];
+        var args = BenchSpecial[i][1];
+        var exact = BenchSpecial[i][2];
+        var a = {name: name, points: args.length, max_diff: null, script_err: null, native_err: null};
+        for (j = 0; j < args.length; j++) {
+            var s = ScriptSpecial[name](args[j]);
+            if (native) {
+                var n = Native[name](args[j]);
+                a.max_diff = Math.max(a.max_diff, bench_rel_err(n, s));
+                if (exact !== undefined) {
+                    a.native_err = Math.max(a.native_err, bench_rel_err(n, exact[j]));
+                }
+            }
+            if (exact !== undefined) {
+                a.script_err = Math.max(a.script_err, bench_rel_err(s, exact[j]));
+            }
+        }
+        r.push(a);
+    }
+    var sargs = bench_special_script_args();
+    var nargs = bench_special_args();
+    for (i = 0; i < BenchSpecialComplex.length; i++) {
+        var method = BenchSpecialComplex[i];
+        var c = {name: "complex." + method, points: sargs.length, max_diff: null, script_err: null, native_err: null};
+        if (NativeComplex !== null) {
+            for (j = 0; j < sargs.length; j++) {
+                c.max_diff = Math.max(c.max_diff, bench_rel_err(nargs[j][method](), sargs[j][method]()));
+            }
+        }
+        r.push(c);
+    }
+    bench_reset();
+    return r;
+}
+
+// Deterministic, well conditioned test matrix.
+function bench_matrix(rows, cols) {
+    var m = new Mat(rows, cols);
+    for (var i = 1; i <= rows; i++) {
+        for (var j = 1; j <= cols; j++) {
+            m.set(i, j, 1 / (i + j) + (i === j ? rows : 0));
+        }
+    }
+    return m;
+}
+
+function bench_matrices() {
+    var r = [];
+    var add = function(name, n, iterations, fn) {
+        var a, b;
+        var bm = new Benchmark("matrix." + name + "." + n, iterations, "op", function() {}, function() {
+            fn(a, b);
+        });
+        bm.prepare = function() {
+            bench_reset();
+            if (name === "complex2") {
+                // n x n/2 in, n x n out, so that the result fits in the
+                // same 64 registers as the other sizes
+                a = bench_matrix(n, n / 2);
+            } else {
+                a = bench_matrix(n, n);
+            }
+            b = bench_matrix(n, n);
+        };
+        r.push(bm);
+    };
+    for (var n = 1; n <= 8; n++) {
+        add("det", n, 200, function(a, b) { a.det(); });
+        add("inverse", n, 200, function(a, b) { a.inverse(); });
+        add("times", n, 200, function(a, b) { a.times(b); });
+        if (n % 2 === 0) {
+            add("complex2", n, 200, function(a, b) { a.complex2(); });
+        }
+    }
+    return r;
+}
+
+function bench_init() {
+    var i;
+    Benchmarks = [];
+    for (i = 0; i < BenchOpcodes.length; i++) {
+        Benchmarks.push(bench_opcode(BenchOpcodes[i]));
+    }
+    for (i = 0; i < BenchPrograms.length; i++) {
+        Benchmarks.push(bench_program(BenchPrograms[i]));
+    }
+    Benchmarks = Benchmarks.concat(bench_special());
+    Benchmarks = Benchmarks.concat(bench_matrices());
+}
+
+// Count the program lines executed by one run, so that program benchmarks
+// can also be reported per step. This is done outside of the timed runs
+// because wrapping step() costs time of its own. NativeVM is switched off
+// meanwhile so that every line goes through step().
+function bench_count_steps(b) {
+    var count = 0;
+    var real = step;
+    var vm = NativeVM;
+    step = function() {
+        count++;
+        real();
+    };
+    NativeVM = null;
+    try {
+        b.setup();
+        b.fn();
+    } finally {
+        step = real;
+        NativeVM = vm;
+    }
+    return count;
+}
+
+function bench_run(b) {
+    var now = typeof(bench_now) === "function" ? bench_now : bench_now_default;
+    var n = Math.max(1, Math.round(b.iterations * BenchOptions.scale));
+    var samples = [];
+    if (b.prepare !== undefined) {
+        b.prepare();
+    } else {
+        bench_reset();
+    }
+    if (b.unit === "run") {
+        b.steps = bench_count_steps(b);
+    }
+    for (var rep = 0; rep < BenchOptions.warmup + BenchOptions.reps; rep++) {
+        var t = 0;
+        for (var i = 0; i < n; i++) {
+            b.setup();
+            var start = now();
+            b.fn();
+            t += now() - start;
+        }
+        if (rep >= BenchOptions.warmup) {
+            samples.push(t * 1e6 / (n * b.batch));
+        }
+    }
+    samples.sort(function(a, b) { return a - b; });
+    var sum = 0;
+    for (i = 0; i < samples.length; i++) {
+        sum += samples[i];
+    }
+    var mean = sum / samples.length;
+    var sq = 0;
+    for (i = 0; i < samples.length; i++) {
+        sq += (samples[i] - mean) * (samples[i] - mean);
+    }
+    var mid = Math.floor(samples.length / 2);
+    var median = samples.length % 2 ? samples[mid] : (samples[mid-1] + samples[mid]) / 2;
+    return {
+        name: b.name,
+        unit: b.unit,
+        iterations: n,
+        steps: b.steps,
+        step_ns: b.steps > 0 ? median / b.steps : null,
+        median_ns: median,
+        min_ns: samples[0],
+        mean_ns: mean,
+        stddev_pct: mean > 0 ? Math.sqrt(sq / samples.length) / mean * 100 : 0
+    };
+}
+
+function bench_compare(baseline, results, threshold) {
+    var old = {};
+    var r = [];
+    for (var i = 0; i < baseline.results.length; i++) {
+        old[baseline.results[i].name] = baseline.results[i];
+    }
+    BenchRegressions = 0;
+    for (i = 0; i < results.length; i++) {
+        var b = old[results[i].name];
+        var c = {name: results[i].name, baseline_ns: null, current_ns: results[i].median_ns, change_pct: null, verdict: "new"};
+        if (b !== undefined) {
+            c.baseline_ns = b.median_ns;
+            c.change_pct = (c.current_ns / c.baseline_ns - 1) * 100;
+            if (c.change_pct > threshold) {
+                c.verdict = "slower";
+                BenchRegressions++;
+            } else if (c.change_pct < -threshold) {
+                c.verdict = "faster";
+            } else {
+                c.verdict = "same";
+            }
+        }
+        r.push(c);
+    }
+    return r;
+}
+
+function bench_json_value(v) {
+    if (v === null || v === undefined) {
+        return "null";
+    } else if (typeof(v) === "number") {
+        if (!isFinite(v)) {
+            return "null";
+        }
+        // timings to 0.1 ns, errors to four significant digits
+        return Math.abs(v) >= 1 || v === 0 ? (Math.round(v * 10) / 10).toString() : Number(v.toPrecision(4)).toString();
+    } else if (typeof(v) === "string") {
+        return '"' + v.replace(/\\/g, "\\\\").replace(/"/g, '\\"') + '"';
+    } else {
+        return String(v);
+    }
+}
+
+// Serialise a list of flat objects, one per line, keeping the key order
+// given in "keys".
+function bench_json_list(list, keys) {
+    var lines = [];
+    for (var i = 0; i < list.length; i++) {
+        var fields = [];
+        for (var k = 0; k < keys.length; k++) {
+            fields.push('"' + keys[k] + '": ' + bench_json_value(list[i][keys[k]]));
+        }
+        lines.push("    {" + fields.join(", ") + "}");
+    }
+    return "[\n" + lines.join(",\n") + "\n  ]";
+}
+
+function bench_parse_args(args) {
+    for (var i = 0; i < args.length; i++) {
+        var m = /^--([a-z]+)=(.*)$/.exec(String(args[i]));
+        if (m === null || BenchOptions[m[1]] === undefined) {
+            throw new Error("unknown benchmark option: " + args[i]);
+        }
+        if (m[1] === "filter" || m[1] === "baseline") {
+            BenchOptions[m[1]] = m[2];
+        } else {
+            BenchOptions[m[1]] = Number(m[2]);
+        }
+    }
+}
+
+function bench_main(args) {
+    bench_parse_args(args || []);
+    if (Display === undefined) {
+        Display = {
+            clear_digit: function(i) {},
+            clear_digits: function() {},
+            clear_shift: function() {},
+            set_complex: function(on) {},
+            set_comma: function(i) {},
+            set_decimal: function(i) {},
+            set_digit: function(i, d) {},
+            set_neg: function() {},
+            set_prgm: function(on) {},
+            set_shift: function(mode) {},
+            set_trigmode: function(mode) {},
+            set_user: function(on) {}
+        };
+    }
+    init();
+    bench_init();
+    var filter = BenchOptions.filter !== null ? new RegExp(BenchOptions.filter) : null;
+    var results = [];
+    for (var i = 0; i < Benchmarks.length; i++) {
+        if (filter === null || filter.test(Benchmarks[i].name)) {
+            results.push(bench_run(Benchmarks[i]));
+        }
+    }
+    bench_reset();
+    var s = "{\n" +
+        '  "format": 1,\n' +
+        '  "options": {"warmup": ' + BenchOptions.warmup +
+            ', "reps": ' + BenchOptions.reps +
+            ', "scale": ' + BenchOptions.scale + '},\n' +
+        '  "results": ' + bench_json_list(results,
+            ["name", "unit", "iterations", "steps", "step_ns", "median_ns", "min_ns", "mean_ns", "stddev_pct"]) +
+        ',\n  "accuracy": ' + bench_json_list(bench_accuracy(),
+            ["name", "points", "max_diff", "script_err", "native_err"]);
+    if (BenchOptions.baseline !== null) {
+        var text = readFile(BenchOptions.baseline);
+        var baseline = typeof(JSON) === "object" ? JSON.parse(text) : eval("(" + text + ")");
+        s += ',\n  "threshold_pct": ' + BenchOptions.threshold +
+            ',\n  "comparison": ' + bench_json_list(bench_compare(baseline, results, BenchOptions.threshold),
+                ["name", "baseline_ns", "current_ns", "change_pct", "verdict"]) +
+            ',\n  "regressions": ' + BenchRegressions;
+    }
+    return s + "\n}";
+}
@@ -51,6 +51,9 @@ function OpcodeInfo(keys, defn, programmable, user) {
     this.defn = defn;
     this.programmable = programmable !== false;
     this.user = user;
+    // STO and RCL of a matrix, whose keys are the same as those of STO .1
+    // to .5 and RCL .1 to .5
+    this.matrix = false;
 }
 
 var OpSqrt      = new OpcodeInfo([11],      op_sqrt);
@@ -252,41 +255,59 @@ function sign(x) {
     return (x > 0) ? 1 : -1;
 }
 
-function sin_drg_mode(x) {
+// Which quarter of a full circle x is an exact multiple of in deg/grad
+// mode, or -1. These give exact results, free of roundoff errors.
+function quarter_circle(x) {
+    if (FullCircle !== 360 && FullCircle !== 400) {
+        return -1;
+    }
+    var q = (x % FullCircle) / (FullCircle / 4);
+    if (q !== Math.floor(q)) {
+        return -1;
+    }
+    return (q + 4) % 4;
+}
+
+// Reduce x to less than a full circle in deg/grad mode before converting
+// to radians, so that large angles do not lose precision.
+function to_radians(x) {
     if (FullCircle === 360 || FullCircle === 400) {
-        // check for exact values in deg/grad mode to avoid roundoff errors
-        var t = Math.abs(x % FullCircle);
-        if (t === 0 || t === FullCircle/2) {
-            return 0;
-        }
+        x %= FullCircle;
+    }
+    return x * TrigFactor;
+}
+
+function sin_drg_mode(x) {
+    switch (quarter_circle(x)) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return 0;
+        case 3: return -1;
     }
-    return Math.sin(x * TrigFactor);
+    return Math.sin(to_radians(x));
 }
 
 function cos_drg_mode(x) {
-    if (FullCircle === 360 || FullCircle === 400) {
-        // check for exact values in deg/grad mode to avoid roundoff errors
-        var t = Math.abs(x % FullCircle);
-        if (t === FullCircle/4 || t === FullCircle*3/4) {
-            return 0;
-        }
+    switch (quarter_circle(x)) {
+        case 0: return 1;
+        case 1: return 0;
+        case 2: return -1;
+        case 3: return 0;
     }
-    return Math.cos(x * TrigFactor);
+    return Math.cos(to_radians(x));
 }
 
 function tan_drg_mode(x) {
-    if (FullCircle === 360 || FullCircle === 400) {
-        // check for exact values in deg/grad mode to avoid roundoff errors
-        var t = Math.abs(x % FullCircle);
-        if (t === 0 || t === FullCircle/2) {
+    switch (quarter_circle(x)) {
+        case 0:
+        case 2:
             return 0;
-        }
-        if (t === FullCircle/4 || t === FullCircle*3/4) {
+        case 1:
+        case 3:
             Flags[9] = true;
             return MAX;
-        }
     }
-    return Math.tan(x * TrigFactor);
+    return Math.tan(to_radians(x));
 }
 
 function sinh(x) {
@@ -298,7 +319,120 @@ function cosh(x) {
 }
 
 function tanh(x) {
-    return (Math.exp(2*x) - 1) / (Math.exp(2*x) + 1);
+    // exp(-2|x|) cannot overflow, so large x gives +-1 rather than NaN
+    var e = Math.exp(-2*Math.abs(x));
+    return sign(x) * (1 - e) / (1 + e);
+}
+
+function asinh(x) {
+    return sign(x) * Math.log(Math.abs(x) + Math.sqrt(x*x + 1));
+}
+
+function acosh(x) {
+    return Math.log(x + Math.sqrt(x*x - 1));
+}
+
+function atanh(x) {
+    return Math.log((1 + x) / (1 - x)) / 2;
+}
+
+// Spouge approximation
+// https://en.wikipedia.org/wiki/Spouge's_approximation
+var SpougeCoefficients = (function() {
+    var kc = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12];
+    var kf = 1.0;
+    kc[0] = Math.sqrt(2.0 * Math.PI);
+    for (var k = 1; k < 12; k++) {
+        kc[k] = Math.exp(12.0 - k) * Math.pow(12.0 - k, k - 0.5) / kf;
+        kf *= -k;
+    }
+    return kc;
+})();
+
+function gamma(z) {
+    var kc = SpougeCoefficients;
+    var acc = kc[0];
+    for (var k = 1; k < 12; k++) {
+        acc += kc[k] / (z + k);
+    }
+    acc *= Math.exp(-(z + 12)) * Math.pow(z + 12, z + 0.5);
+    return acc / z;
+}
+
+// 0! to 69!, multiplied in the same order as qt/specfun.cpp
+var Factorials = (function() {
+    var fact = [];
+    for (var n = 0; n < 70; n++) {
+        var r = 1;
+        for (var x = n; x > 1; x -= 1) {
+            r *= x;
+        }
+        fact[n] = r;
+    }
+    return fact;
+})();
+
+function factorial(x) {
+    if (x >= 0 && x === Math.floor(x)) {
+        if (x > 69) {
+            Flags[9] = true;
+            return MAX;
+        }
+        return Factorials[x];
+    } else {
+        x += 1;
+        if (x <= 0 && x === Math.floor(x)) {
+            Flags[9] = true;
+            return -MAX;
+        }
+        if (x < -70.06400563) {
+            return 0;
+        }
+        if (x > 70.95757445) {
+            Flags[9] = true;
+            return MAX;
+        }
+        if (x >= -10) {
+            return gamma(x);
+        } else {
+            return Math.PI / (gamma(1-x) * Math.sin(Math.PI * x));
+        }
+    }
+}
+
+// The Qt front end provides native versions of the special functions as
+// Native (see qt/specfun.cpp). The script versions are kept here so that
+// the benchmarks can compare the two.
+var ScriptSpecial = {
+    sin_drg_mode: sin_drg_mode,
+    cos_drg_mode: cos_drg_mode,
+    tan_drg_mode: tan_drg_mode,
+    sinh: sinh,
+    cosh: cosh,
+    tanh: tanh,
+    asinh: asinh,
+    acosh: acosh,
+    atanh: atanh,
+    gamma: gamma,
+    factorial: factorial
+};
+var NativeComplex = null;
+var NativeVM = null;
+
+if (typeof(Native) === "object") {
+    sin_drg_mode = Native.sin_drg_mode;
+    cos_drg_mode = Native.cos_drg_mode;
+    tan_drg_mode = Native.tan_drg_mode;
+    sinh = Native.sinh;
+    cosh = Native.cosh;
+    tanh = Native.tanh;
+    asinh = Native.asinh;
+    acosh = Native.acosh;
+    atanh = Native.atanh;
+    gamma = Native.gamma;
+    factorial = Native.factorial;
+    NativeComplex = Native.complex;
+    NativeVM = Native.vm;
 }
 
 function Complex(re, im) {
@@ -460,6 +594,21 @@ function Complex(re, im) {
     this.toString = function() {
         return "(" + this.re + "," + this.im + ")";
     };
+
+    if (NativeComplex !== null) {
+        this.acos = NativeComplex.acos;
+        this.acosh = NativeComplex.acosh;
+        this.asin = NativeComplex.asin;
+        this.asinh = NativeComplex.asinh;
+        this.atan = NativeComplex.atan;
+        this.atanh = NativeComplex.atanh;
+        this.cos = NativeComplex.cos;
+        this.cosh = NativeComplex.cosh;
+        this.sin = NativeComplex.sin;
+        this.sinh = NativeComplex.sinh;
+        this.tan = NativeComplex.tan;
+        this.tanh = NativeComplex.tanh;
+    }
 }
 
 Complex.one = new Complex(1, 0);
@@ -471,26 +620,51 @@ var C = 2;
 var D = 3;
 var E = 4;
 
+// Front ends that load jsmat/matrix.js on first use rather than at startup
+// define RequireMatrix() to load it.
+function new_matrix(a, b, c) {
+    if (typeof(Matrix) === "undefined") {
+        RequireMatrix();
+    }
+    if (b === undefined) {
+        return new Matrix(a);
+    }
+    return new Matrix(a, b, c);
+}
+
 function Mat() {
     if (typeof(arguments[0]) === "number" && typeof(arguments[1]) === "number") {
         this.rows = arguments[0];
         this.cols = arguments[1];
-        this.m = new Matrix(this.rows, this.cols, arguments[2]);
+        if (this.rows === 0 && this.cols === 0) {
+            // created when needed, see matrix()
+            this.m = null;
+        } else {
+            this.m = new_matrix(this.rows, this.cols, arguments[2]);
+        }
     } else if (typeof(arguments[0]) === "object") {
         this.m = arguments[0];
         this.rows = this.m.getRowDimension();
         this.cols = this.m.getColumnDimension();
     }
 
+    this.matrix = function() {
+        if (this.m === null) {
+            this.m = new_matrix(0, 0);
+        }
+        return this.m;
+    };
+
     this.complex2 = function() {
-        var r = new Matrix(this.rows, this.cols*2);
+        var a = this.matrix();
+        var r = new_matrix(this.rows, this.cols*2);
         for (var i = 0; i < this.rows; i++) {
             for (var j = 0; j < this.cols; j++) {
-                r.set(i, j, this.m.get(i, j));
+                r.set(i, j, a.get(i, j));
                 if (i < this.rows/2) {
-                    r.set(this.rows/2+i, this.cols+j, this.m.get(i, j));
+                    r.set(this.rows/2+i, this.cols+j, a.get(i, j));
                 } else {
-                    r.set(i-this.rows/2, this.cols+j, -this.m.get(i, j));
+                    r.set(i-this.rows/2, this.cols+j, -a.get(i, j));
                 }
             }
         }
@@ -498,70 +672,71 @@ function Mat() {
     };
 
     this.complex3 = function() {
-        return new Mat(this.m.getMatrix(0, this.rows-1, 0, this.cols/2-1));
+        return new Mat(this.matrix().getMatrix(0, this.rows-1, 0, this.cols/2-1));
     };
 
     this.copy = function() {
-        return new Mat(this.m.copy());
+        return new Mat(this.matrix().copy());
     };
 
     this.det = function() {
-        return this.m.det();
+        return this.matrix().det();
     };
 
     this.get = function(row, col) {
-        return this.m.get(row-1, col-1);
+        return this.matrix().get(row-1, col-1);
     };
 
     this.inverse = function() {
-        return new Mat(this.m.inverse());
+        return new Mat(this.matrix().inverse());
     };
 
     this.minus = function(B) {
-        return new Mat(this.m.minus(B.m));
+        return new Mat(this.matrix().minus(B.matrix()));
     };
 
     this.norm = function() {
-        return this.m.normInf();
+        return this.matrix().normInf();
     };
 
     this.normF = function() {
-        return this.m.normF();
+        return this.matrix().normF();
     };
 
     this.partition = function() {
-        var r = new Matrix(this.rows*2, this.cols/2);
+        var a = this.matrix();
+        var r = new_matrix(this.rows*2, this.cols/2);
         for (var i = 0; i < this.rows; i++) {
             for (var j = 0; j < this.cols; j += 2) {
-                r.set(i, j/2, this.m.get(i, j));
-                r.set(this.rows+i, j/2, this.m.get(i, j+1));
+                r.set(i, j/2, a.get(i, j));
+                r.set(this.rows+i, j/2, a.get(i, j+1));
             }
         }
         return new Mat(r);
     };
 
     this.plus = function(B) {
-        return new Mat(this.m.plus(B.m));
+        return new Mat(this.matrix().plus(B.matrix()));
     };
 
     this.residual = function(Y, X) {
-        return new Mat(this.m.minus(Y.m.times(X.m)));
+        return new Mat(this.matrix().minus(Y.matrix().times(X.matrix())));
     };
 
     this.set = function(row, col, value) {
-        this.m.set(row-1, col-1, value);
+        this.matrix().set(row-1, col-1, value);
     };
 
     this.times = function(B) {
-        return new Mat(this.m.times(B.m));
+        return new Mat(this.matrix().times(B.matrix()));
     };
 
     this.timesScalar = function(s) {
-        return new Mat(this.m.timesScalar(s));
+        return new Mat(this.matrix().timesScalar(s));
     };
 
     this.transpose = function() {
-        return new Mat(this.m.transpose());
+        return new Mat(this.matrix().transpose());
     };
 
     this.toString = function() {
@@ -569,11 +744,12 @@ function Mat() {
     };
 
     this.unpartition = function() {
-        var r = new Matrix(this.rows/2, this.cols*2);
+        var a = this.matrix();
+        var r = new_matrix(this.rows/2, this.cols*2);
         for (var i = 0; i < this.rows/2; i++) {
             for (var j = 0; j < this.cols; j++) {
-                r.set(i, j*2, this.m.get(i, j));
-                r.set(i, j*2+1, this.m.get(this.rows/2+i, j));
+                r.set(i, j*2, a.get(i, j));
+                r.set(i, j*2+1, a.get(this.rows/2+i, j));
             }
         }
         return new Mat(r);
@@ -1154,6 +1330,85 @@ function op_matrix_det() {
     });
 }
 
+// Call subroutine n for each element of the matrix in X, with the stack
+// filled with the element as op_solve() does, and put what it leaves in X
+// into the result matrix.
+function op_matrix_map(n) {
+    if (!(Stack[0] instanceof Descriptor)) {
+        throw new CalcError(11);
+    }
+    // Returns whether subroutine n got back to its RTN. An error in it is
+    // thrown from here, with the calls it made taken off ReturnStack.
+    var call = function(n) {
+        var r = ReturnStack.length;
+        try {
+            op_gsb(n);
+            while (Running && ReturnStack.length > r) {
+                if (step_native(r, RunLines) === 0) {
+                    step_line();
+                }
+            }
+        } catch (e) {
+            ReturnStack.length = r;
+            Running = false;
+            throw e;
+        }
+        return ReturnStack.length === r;
+    };
+    var a = g_Matrix[Stack[0].label];
+    var values = [];
+    var i, j, k;
+    for (i = 1; i <= a.rows; i++) {
+        for (j = 1; j <= a.cols; j++) {
+            values.push(a.get(i, j));
+        }
+    }
+    var stack = Stack.slice(0);
+    var stacki = StackI.slice(0);
+    var results = map_native(n, values);
+    if (results !== null) {
+        // as returning from the last call would
+        if (!Running) {
+            PC = 0;
+        }
+    } else {
+        // on an error, or a stop before the RTN, leave the stack as it was
+        // and the result matrix alone
+        var done = false;
+        results = [];
+        try {
+            for (k = 0; k < values.length; k++) {
+                fill(values[k]);
+                if (!call(n)) {
+                    break;
+                }
+                results.push(Stack[0]);
+            }
+            done = k === values.length;
+        } finally {
+            for (i = done ? 1 : 0; i < 4; i++) {
+                Stack[i] = stack[i];
+                StackI[i] = stacki[i];
+            }
+        }
+        if (!done) {
+            return;
+        }
+    }
+    var m = new Mat(a.rows, a.cols);
+    k = 0;
+    for (i = 1; i <= a.rows; i++) {
+        for (j = 1; j <= a.cols; j++) {
+            m.set(i, j, results[k++]);
+        }
+    }
+    LastX = stack[0];
+    LastXI = stacki[0];
+    g_Matrix[Result] = m;
+    Stack[0] = new Descriptor(Result);
+    StackI[0] = stacki[0];
+}
+
 function op_abs() {
     if (Stack[0] instanceof Descriptor) {
         throw new CalcError(1);
@@ -1241,12 +1496,23 @@ function op_div() {
 }
 
 function op_solve(n) {
+    // Returns whether subroutine n got back to its RTN. An error in it is
+    // thrown from here, with the calls it made taken off ReturnStack.
     var call = function(n) {
         var r = ReturnStack.length;
-        op_gsb(n);
-        while (ReturnStack.length > r) {
-            step();
+        try {
+            op_gsb(n);
+            while (Running && ReturnStack.length > r) {
+                if (step_native(r, RunLines) === 0) {
+                    step_line();
+                }
+            }
+        } catch (e) {
+            ReturnStack.length = r;
+            Running = false;
+            throw e;
         }
+        return ReturnStack.length === r;
     };
     // This is http://mathworld.wolfram.com/SecantMethod.html
     var eps = 1e-9;
@@ -1399,9 +1665,7 @@ function op_asinh() {
             return x.asinh();
         });
     } else {
-        unop(function(x) {
-            return sign(x) * Math.log(Math.abs(x) + Math.sqrt(x*x + 1));
-        });
+        unop(asinh);
     }
 }
 
@@ -1411,9 +1675,7 @@ function op_acosh() {
             return x.acosh();
         });
     } else {
-        unop(function(x) {
-            return Math.log(x + Math.sqrt(x*x - 1));
-        });
+        unop(acosh);
     }
 }
 
@@ -1423,9 +1685,7 @@ function op_atanh() {
             return x.atanh();
         });
     } else {
-        unop(function(x) {
-            return Math.log((1 + x) / (1 - x)) / 2;
-        });
+        unop(atanh);
     }
 }
 
@@ -1440,7 +1700,7 @@ function op_sin() {
 }
 
 function op_dim(m) {
-    var oldmat = g_Matrix[m].m;
+    var oldmat = g_Matrix[m].matrix();
     var r = Stack[1];
     var c = Stack[0];
     var i;
@@ -1468,7 +1728,7 @@ function op_dim(m) {
                 a[a.length] = b;
             }
         }
-        g_Matrix[m] = new Mat(new Matrix(a));
+        g_Matrix[m] = new Mat(new_matrix(a));
     } else {
         g_Matrix[m] = new Mat(Stack[1], Stack[0]);
     }
@@ -1661,12 +1921,23 @@ function op_mul() {
 }
 
 function op_integrate(n) {
+    // Returns whether subroutine n got back to its RTN. An error in it is
+    // thrown from here, with the calls it made taken off ReturnStack.
     var call = function(n) {
         var r = ReturnStack.length;
-        op_gsb(n);
-        while (ReturnStack.length > r) {
-            step();
+        try {
+            op_gsb(n);
+            while (Running && ReturnStack.length > r) {
+                if (step_native(r, RunLines) === 0) {
+                    step_line();
+                }
+            }
+        } catch (e) {
+            ReturnStack.length = r;
+            Running = false;
+            throw e;
         }
+        return ReturnStack.length === r;
     };
     // This is http://mathworld.wolfram.com/SimpsonsRule.html
     var eps = 1e-9;
@@ -1826,6 +2097,7 @@ function op_back() {
     if (Prgm) {
         if (PC > 0) {
             Program.splice(PC, 1);
+            NativeProgram = null;
             PC--;
         }
         return;
@@ -2173,55 +2445,7 @@ function op_mem() {
 }
 
 function op_fact() {
-    unop(function(x) {
-        if (x >= 0 && x === Math.floor(x)) {
-            if (x > 69) {
-                Flags[9] = true;
-                return MAX;
-            }
-            var r = 1;
-            while (x > 1) {
-                r *= x;
-                x -= 1;
-            }
-            return r;
-        } else {
-            x += 1;
-            var gamma = function(z) {
-                // Spouge approximation
-                // https://en.wikipedia.org/wiki/Spouge's_approximation
-                var kc = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12];
-                var kf = 1.0;
-                kc[0] = Math.sqrt(2.0 * Math.PI);
-                for (var k = 1; k < 12; k++) {
-                    kc[k] = Math.exp(12.0 - k) * Math.pow(12.0 - k, k - 0.5) / kf;
-                    kf *= -k;
-                }
-                var acc = kc[0];
-                for (k = 1; k < 12; k++) {
-                    acc += kc[k] / (z + k);
-                }
-                acc *= Math.exp(-(z + 12)) * Math.pow(z + 12, z + 0.5);
-                return acc / z;
-            };
-            if (x <= 0 && x === Math.floor(x)) {
-                Flags[9] = true;
-                return -MAX;
-            }
-            if (x < -70.06400563) {
-                return 0;
-            }
-            if (x > 70.95757445) {
-                Flags[9] = true;
-                return MAX;
-            }
-            if (x >= -10) {
-                return gamma(x);
-            } else {
-                return Math.PI / (gamma(1-x) * Math.sin(Math.PI * x));
-            }
-        }
-    });
+    unop(factorial);
 }
 
 function op_mean() {
@@ -2377,6 +2601,10 @@ function decode_matrix(k) {
             case '8': return new Opcode(new OpcodeInfo([42,16,8], op_matrix_normf));
             case '9': return new Opcode(new OpcodeInfo([42,16,9], op_matrix_det));
         }
+        var i = "qE)^\\".indexOf(k);
+        if (i >= 0) {
+            return new Opcode(new OpcodeInfo([42,16,11+i]), function() { op_matrix_map(11+i); });
+        }
     };
     return null;
 }
@@ -2712,7 +2940,7 @@ function decode_sto(k) {
     var op = null;
     var g = false;
     Prefix = function(k) {
-        var i, u;
+        var i, u, info;
         if (k === '.') {
             f = 10;
             Prefix = OldPrefix;
@@ -2762,7 +2990,9 @@ function decode_sto(k) {
                     return new Opcode(new OpcodeInfo([44,43,11+i]), function() { op_sto_matrix_imm(i); });
                 } else {
                     u = User; // capture current value
-                    return new Opcode(new OpcodeInfo([44,11+i], null, true, User), function() { op_sto_matrix(i, u); });
+                    info = new OpcodeInfo([44,11+i], null, true, User);
+                    info.matrix = true;
+                    return new Opcode(info, function() { op_sto_matrix(i, u); });
                 }
             }
         }
@@ -2775,7 +3005,7 @@ function decode_rcl(k) {
     var op = null;
     var g = false;
     Prefix = function(k) {
-        var i, u;
+        var i, u, info;
         if (k === '.') {
             f = 10;
             Prefix = OldPrefix;
@@ -2833,7 +3063,9 @@ function decode_rcl(k) {
                     return new Opcode(new OpcodeInfo([45,43,11+i]), function() { op_rcl_matrix_imm(i); });
                 } else {
                     u = User; // capture current value
-                    return new Opcode(new OpcodeInfo([45,11+i], null, true, User), function() { op_rcl_matrix(i, u); });
+                    info = new OpcodeInfo([45,11+i], null, true, User);
+                    info.matrix = true;
+                    return new Opcode(info, function() { op_rcl_matrix(i, u); });
                 }
             }
         }
@@ -2871,7 +3103,8 @@ function decode(k) {
     return r;
 }
 
-function step() {
+// Run the program line at PC, throwing any error it has.
+function step_line() {
     if (PC === 0) {
         PC = 1;
     }
@@ -2879,29 +3112,102 @@ function step() {
         //console.log("PC", PC, Program[PC].info.defn);
         var p = PC;
         PC++;
-        try {
-            Program[p].exec();
-        } catch (e) {
-            Running = false;
-            if (e.name === "CalcError") {
-                update_lcd("Error " + e.code);
-                DelayUpdate = -1;
-            } else {
-                throw e;
-            }
-        }
+        Program[p].exec();
     } else {
         op_rtn();
     }
 }
 
+function step() {
+    try {
+        step_line();
+    } catch (e) {
+        Running = false;
+        if (e.name === "CalcError") {
+            update_lcd("Error " + e.code);
+            DelayUpdate = -1;
+        } else {
+            throw e;
+        }
+    }
+}
+
+// The program NativeVM was last given, if it is still the current one, and
+// for each line of it whether NativeVM is worth starting there.
+var NativeProgram = null;
+var NativeStarts = [];
+
+// The most lines NativeVM runs in one go before letting the front end
+// handle keys.
+var RunLines = 10000;
+
+// Give NativeVM the keys of each program line. STO A and RCL A have the
+// same keys as STO .1 and RCL .1, and labels .1 to .9 are keyed 0.1 to 0.9
+// where NativeVM only takes whole numbers, so those are left out for step().
+function load_native_program() {
+    var lines = [];
+    for (var i = 1; i < Program.length; i++) {
+        var info = Program[i].info;
+        if (info.matrix || info.keys.join(",").indexOf(".") >= 0) {
+            lines.push([]);
+        } else {
+            lines.push(info.keys);
+        }
+    }
+    NativeStarts = NativeVM.load(lines);
+    NativeProgram = Program;
+}
+
+// Run program lines with NativeVM, where the front end provides one (see
+// qt/vm.cpp). It stops before the first line that it leaves to step(),
+// after a return that leaves depth or fewer entries on ReturnStack, when
+// the program stops or after limit lines. Returns the number of lines run.
+function step_native(depth, limit) {
+    if (NativeVM === null || Flags[8]) {
+        return 0;
+    }
+    if (NativeProgram !== Program) {
+        load_native_program();
+    }
+    if (!NativeStarts[PC === 0 ? 1 : PC]) {
+        return 0;
+    }
+    return NativeVM.run(depth, limit);
+}
+
+// Evaluate subroutine n for each of values with NativeVM, when the
+// subroutine has no branches. Returns the results, or null when
+// op_matrix_map() has to call it for each value.
+function map_native(n, values) {
+    if (NativeVM === null || Flags[8] || values.length === 0) {
+        return null;
+    }
+    if (NativeProgram !== Program) {
+        load_native_program();
+    }
+    return NativeVM.map(n, values);
+}
+
+// Run up to limit program lines with NativeVM and then at most one line
+// with step(). A line left to the script may take a while, or be R/S or
+// PSE, so the front end gets to handle keys and paint after each one, as
+// it did before NativeVM. Returns the number of lines run.
+function run_lines(limit) {
+    var n = step_native(-1, limit);
+    if (Running && n < limit) {
+        step();
+        n++;
+    }
+    return n;
+}
+
 function run() {
     RunTimer = null;
     if (!Running) {
         alert("run() called when not Running");
         return;
     }
-    step();
+    run_lines(RunLines);
     if (Running) {
         RunTimer = setTimeout(run, 0);
     } else {
@@ -2947,6 +3253,7 @@ function key_down(k, override) {
             if (Prgm && op.info.programmable) {
                 PC++;
                 Program.splice(PC, 0, op);
+                NativeProgram = null;
             } else {
                 op.exec();
                 if (Running) {
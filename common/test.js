@@ -48,6 +48,12 @@ var Tests = [
     ["gc", 60, 1e-9],
     ["45t", 1, 1e-9],
     ["gt", 45],
+    ["90s", 1],
+    ["270c", 0],
+    ["3600030s", Math.sin(30 * Math.PI / 180)],
+    ["1e17c", Math.cos(280 * Math.PI / 180)],
+    ["400fGt", 1],
+    ["400_fGt", -1],
     // rad, grad
     // p27
     ["1.2345f2", 1.1404, 0.0001],
@@ -427,6 +433,37 @@ var Tests = [
     ["R_E", new MatrixCheck(B, 2, 3, [[1, 3, 5], [7, 9, 17]])],
     ["fe)"],
     ["f_5", new MatrixCheck(C, 3, 3, [[29, 39, 73], [37, 51, 95], [66, 90, 168]])],
+    // f MATRIX A-E calls a subroutine for each element
+    ["gPfrfTqgq1+gUfTE2g/G0rgUfT0r\\gUfT^R_qf_EgUgP"],
+    ["R_q", new MatrixCheck(A, 2, 3, [[1, 2, 3], [4, 5, 9]])],
+    ["f_q", new MatrixCheck(C, 2, 3, [[2, 5, 10], [17, 26, 82]])],
+    ["L", new MatrixCheck(A, 2, 3)],
+    ["f_E", new MatrixCheck(C, 2, 3, [[1, 0.5, 0.3333], [0.25, 0.2, 0.1111]], 0.001)],
+    ["U^", new MatrixCheck(C, 2, 3, [[1, 0.5, 0.3333], [0.25, 0.2, 0.1111]], 0.001)],
+    ["1f_q", "Error 11"],
+    ["\b"],
+    // a register recalled before it is stored to carries over to the next
+    // element, and one stored to first does not
+    ["gPfrfTqR2+S2gUfTES3gqR3+gUgP"],
+    ["0S2", 0],
+    ["R_qf_q", new MatrixCheck(C, 2, 3, [[1, 3, 6], [10, 15, 24]])],
+    ["R2", 24],
+    ["R_qf_E", new MatrixCheck(C, 2, 3, [[2, 6, 12], [20, 30, 90]])],
+    ["R3", 9],
+    // an error in the subroutine, or a missing label, leaves the stack and
+    // the result matrix as they were
+    ["gPfrfTq1-\\gUgP"],
+    ["7\r8R_ER_q-", new MatrixCheck(C, 2, 3, [[0, 1, 2], [3, 4, 8]])],
+    ["f_q", "Error 0"],
+    ["r", 8],
+    ["r", 7],
+    ["r", 7],
+    ["r", new MatrixCheck(C, 2, 3, [[0, 1, 2], [3, 4, 8]])],
+    ["f_E", "Error 4"],
+    ["r", 8],
+    ["r", 7],
+    ["r", 7],
+    ["r", new MatrixCheck(C, 2, 3, [[0, 1, 2], [3, 4, 8]])],
     // p157
     ["2\rfsq", 2],
     ["f_1", 2],
@@ -1370,7 +1407,50 @@ var Tests = [
     ["10PR1", 9],
 
     // reset complex mode
-    ["g58"]
+    ["g58"],
+
+    // Programs for each instruction of the program VM (qt/vm.cpp) and each
+    // line it leaves to step(), with the results that step() gives.
+    // number entry, and stack lift after a number that follows ENTER or CLX
+    ["gPfrfT17\r2R1+*\rg\b3ge*+1.5e2_+gUgP"],
+    ["5S1", 5],
+    ["U1", 58.43977796, 1e-9],
+    // stack moves and LastX
+    ["gPfrfT21\r2\r3\r4rgrx-L*+_gUgP"],
+    ["U2", [-5, 1]],
+    // functions of X and y^x
+    ["gPfrfT32qgq\\EgE)g)3^_g_7+fS8*7.9gS+gUgP"],
+    ["U3", 8, 1e-9],
+    // STO and RCL, their arithmetic, RCL followed by arithmetic with and
+    // without stack lift, I and (i)
+    ["gPfrfT43S24S+22S*24S-25S/2R2R+2R*2R-2R/2R2+\rR2*2StRc+ScRt*R2+gUgP"],
+    ["U4", [12, 10]],
+    ["R2", 4],
+    // ISG and DSE followed by GTO, and DSE followed by other lines
+    ["gPfrfT50S41.005S3fT6R3gSS+4f63G65S5fT7R5gSS+4f55G7R42S5f551f557++gUgP"],
+    ["U5", 33],
+    // tests followed by GTO and by other lines, and flags
+    ["gPfrfT90S64\r3g/G19S6fT1g-7G21S+6fT2g*G35S+6fT3g-02S+6g41g614S+6g51g618S+6R6gUgP"],
+    ["U9", 16],
+    // nested subroutines, and returning by running off the end
+    ["gPfrfT80U71+gUfT72U6*gUfT63gP"],
+    ["U8", 7],
+    // labels .1 to .9 are not labels 0 to 9
+    ["gPfrfT52\r3+4*G08fT.17gUfT01gUfT4U.2gUfT.29gUgP"],
+    ["U5", [1, 20]],
+    ["U4", 9],
+    // a result that is not finite stops the program with an error
+    ["gPfrfT10\\gUgP"],
+    ["U1", "Error 0"],
+    ["\b"],
+    // DSE of a negative number
+    ["gPfrfT32.5_S7f571R7gUgP"],
+    ["U3", -3.5],
+    // STO (i) with a matrix descriptor in I
+    ["f_02\r2fsqR_qStf_1"],
+    ["gPfrfT25ScgUgP"],
+    ["U2", function() { return g_Matrix[0].get(1, 1) === 5; }],
+    ["f_0"]
 ];
 
 var TestStart;
@@ -1471,8 +1551,11 @@ function run_tests() {
                     if (p === 0) {
                         p = 1;
                     }
-                    test_log(sprintf("%03d-%s", p, Program[p].info.keys));
-                    step();
+                    if (p < Program.length) {
+                        test_log(sprintf("%03d-%s", p, Program[p].info.keys));
+                    }
+                    // through NativeVM, where the front end provides it
+                    run_lines(RunLines);
                 }
             }
         } else if (typeof(keys) === "function") {
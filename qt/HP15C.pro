@@ -8,7 +8,8 @@ QT += script
 QT += widgets
 
 # Input
-SOURCES += hp15c.cpp
+HEADERS += specfun.h vm.h
+SOURCES += hp15c.cpp specfun.cpp vm.cpp
 RESOURCES += hp15c.qrc
 ICON = hp15c.icns
 RC_FILE = hp15c.rc
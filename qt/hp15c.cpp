@@ -1,4 +1,6 @@
-#include <cstring>           // for NULL, memset, size_t
+#include <cstdio>            // for fputs, fprintf, stderr, stdout
+#include <cstring>           // for NULL, memset, size_t, strcmp
+#include <vector>            // for vector
 
 #include <QAbstractButton>   // for QAbstractButton
 #include <QAction>           // for QAction
@@ -8,6 +10,8 @@
 #include <QCharRef>          // for operator+, QCharRef
 #include <QClipboard>        // for QClipboard
 #include <QColor>            // for QColor
+#include <QCoreApplication>  // for QCoreApplication
+#include <QElapsedTimer>     // for QElapsedTimer
 #include <QFile>             // for QFile
 #include <QFont>             // for QFont
 #include <QIODevice>         // for QIODevice, QIODevice::ReadOnly
@@ -29,13 +33,18 @@
 #include <QScriptContext>    // for QScriptContext
 #include <QScriptEngine>     // for QScriptEngine, QScriptEngine::ScriptOwnership
 #include <QScriptValue>      // for QScriptValue, QScriptValue::UndefinedValue, QScriptValueList
+#include <QSet>              // for QSet
 #include <QSignalMapper>     // for QSignalMapper
 #include <QSize>             // for QSize, operator+
 #include <QString>           // for QString
+#include <QStringList>       // for QStringList
 #include <QTimer>            // for QTimer
 #include <QWidget>           // for QWidget
 #include <Qt>                // for operator|, AlignLeft, AlignTop, AlignHCenter, yellow
-#include <QtGlobal>          // for Q_UNUSED, qint32
+#include <QtGlobal>          // for Q_UNUSED, qint32, qgetenv
+
+#include "specfun.h"         // for factorial, gamma, sin_drg, sinh, complex, ...
+#include "vm.h"              // for Program, Kernel, State, REGS, REG_I, FLAGS
 
 
 QScriptEngine *script;
@@ -47,6 +56,47 @@ void checkError(const QScriptValue &r)
     }
 }
 
+// Evaluate a script file in the global scope. This also works from inside
+// a native function called by a script, which is how files that are only
+// loaded on first use get loaded.
+void load(const QString &fn)
+{
+    QFile f(fn);
+    if (!f.open(QIODevice::ReadOnly)) {
+        QMessageBox::warning(NULL, "file not found", fn);
+    }
+    QScriptContext *context = script->pushContext();
+    context->setActivationObject(script->globalObject());
+    context->setThisObject(script->globalObject());
+    QScriptValue r = script->evaluate(f.readAll(), fn);
+    script->popContext();
+    f.close();
+    checkError(r);
+}
+
+// Load a script file unless it has been loaded already.
+void require(const QString &fn)
+{
+    static QSet<QString> loaded;
+    if (!loaded.contains(fn)) {
+        loaded.insert(fn);
+        load(fn);
+    }
+}
+
+// Set HP15C_STARTUP_TRACE in the environment to have the time taken to
+// reach each stage of startup written to stderr, counted from the start of
+// main(). Whatever the loader does before main() is not included.
+QElapsedTimer g_StartupClock;
+bool g_StartupTrace;
+
+void startup_trace(const char *stage)
+{
+    if (g_StartupTrace) {
+        fprintf(stderr, "startup: %8.1f ms  %s\n", g_StartupClock.nsecsElapsed() / 1e6, stage);
+    }
+}
+
 class Timeout: public QTimer {
     Q_OBJECT
 public:
@@ -136,7 +186,10 @@ public slots:
     void keyPress(const QString &key);
 protected:
     virtual void keyPressEvent(QKeyEvent *event);
+    virtual void paintEvent(QPaintEvent *event);
 private:
+    void key(const QString &k);
+
     QPixmap face;
     QMap<char, QPixmap> pixmaps;
     QLabel calc;
@@ -221,6 +274,11 @@ CalcWidget::CalcWidget(QWidget *parent)
     prgm.move(410, 100);
     prgm.setFont(font);
 
+    // fetch the key tables as objects rather than evaluating a script
+    // for every entry
+    QScriptValue keytable = script->globalObject().property("KeyTable");
+    QScriptValue extrakeytable = script->globalObject().property("ExtraKeyTable");
+
     QPalette helpPalette;
     helpPalette.setColor(QPalette::Window, Qt::yellow);
     memset(helplabels, 0, sizeof(helplabels));
@@ -237,7 +295,7 @@ CalcWidget::CalcWidget(QWidget *parent)
                 }
             }
             CalcButton *b = new CalcButton(this, face, r, c, h);
-            QString key = script->evaluate(QString("KeyTable[%1][%2]").arg(r).arg(c)).toString();
+            QString key = keytable.property(r).property(c).toString();
             mapper.setMapping(b, key);
             connect(b, SIGNAL(clicked()), &mapper, SLOT(map()));
             buttons[i] = b;
@@ -269,12 +327,9 @@ CalcWidget::CalcWidget(QWidget *parent)
     helpPalette_f.setColor(QPalette::Window, QColor("goldenrod"));
     QPalette helpPalette_g;
     helpPalette_g.setColor(QPalette::Window, QColor("lightblue"));
-    int i = 0;
-    while (true) {
-        QScriptValue info = script->evaluate(QString("ExtraKeyTable[%1]").arg(i));
-        if (info.isUndefined()) {
-            break;
-        }
+    qint32 extrakeys = extrakeytable.property("length").toInt32();
+    for (int i = 0; i < extrakeys; i++) {
+        QScriptValue info = extrakeytable.property(i);
         qint32 r = info.property(0).toInt32();
         qint32 c = info.property(1).toInt32();
         qint32 f = info.property(2).toInt32();
@@ -292,7 +347,6 @@ CalcWidget::CalcWidget(QWidget *parent)
         help->setFont(QFont("Courier", 14));
         help->setVisible(false);
         helplabels[40+r*10+c+(f>0)*40] = help;
-        i++;
     }
     connect(&mapper, SIGNAL(mapped(const QString &)), this, SLOT(keyPress(const QString &)));
 
@@ -411,6 +465,7 @@ void CalcWidget::set_full_keys(bool on)
 
 void CalcWidget::start_tests()
 {
+    require(":/test.js");
     QScriptValue r = script->evaluate("start_tests()");
     checkError(r);
 }
@@ -422,10 +477,7 @@ void CalcWidget::about()
 
 void CalcWidget::keyPress(const QString &key)
 {
-    QScriptValueList args;
-    args << key;
-    QScriptValue r = script->evaluate("key").call(QScriptValue(), args);
-    checkError(r);
+    this->key(key);
 }
 
 void CalcWidget::keyPressEvent(QKeyEvent *event)
@@ -438,10 +490,32 @@ void CalcWidget::keyPressEvent(QKeyEvent *event)
             }
         }
     } else if (s != "") {
-        QScriptValueList args;
-        args << s;
-        QScriptValue r = script->evaluate("key").call(QScriptValue(), args);
-        checkError(r);
+        key(s);
+    }
+}
+
+void CalcWidget::paintEvent(QPaintEvent *event)
+{
+    QWidget::paintEvent(event);
+
+    static bool painted = false;
+    if (!painted) {
+        painted = true;
+        startup_trace("first paint");
+    }
+}
+
+void CalcWidget::key(const QString &k)
+{
+    QScriptValueList args;
+    args << k;
+    QScriptValue r = script->evaluate("key").call(QScriptValue(), args);
+    checkError(r);
+
+    static bool accepted = false;
+    if (!accepted) {
+        accepted = true;
+        startup_trace("first key accepted");
     }
 }
 
@@ -461,8 +535,6 @@ public:
     HP15C(int& argc, char *argv[]);
 
     void init();
-private:
-    void load(const QString &fn);
 };
 
 QScriptValue mylert(QScriptContext *context, QScriptEngine *engine)
@@ -473,6 +545,55 @@ QScriptValue mylert(QScriptContext *context, QScriptEngine *engine)
     return QScriptValue(QScriptValue::UndefinedValue);
 }
 
+QScriptValue print(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(engine);
+
+    fputs(qPrintable(context->argument(0).toString() + "\n"), stdout);
+    return QScriptValue(QScriptValue::UndefinedValue);
+}
+
+// alert() for --bench, which has no windows to show a message box in
+QScriptValue warn(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(engine);
+
+    fputs(qPrintable(context->argument(0).toString() + "\n"), stderr);
+    return QScriptValue(QScriptValue::UndefinedValue);
+}
+
+QScriptValue readFile(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(engine);
+
+    QFile f(context->argument(0).toString());
+    if (!f.open(QIODevice::ReadOnly)) {
+        return context->throwError("file not found: " + f.fileName());
+    }
+    return QScriptValue(QString::fromUtf8(f.readAll()));
+}
+
+QScriptValue RequireMatrix(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(context);
+    Q_UNUSED(engine);
+
+    require(":/matrix.js");
+    return QScriptValue(QScriptValue::UndefinedValue);
+}
+
+QScriptValue bench_now(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(context);
+    Q_UNUSED(engine);
+
+    static QElapsedTimer clock;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+    return QScriptValue(clock.nsecsElapsed() / 1e6);
+}
+
 QScriptValue setInterval(QScriptContext *context, QScriptEngine *engine)
 {
     Q_UNUSED(engine);
@@ -608,18 +729,325 @@ QScriptValue set_user(QScriptContext *context, QScriptEngine *engine)
     return QScriptValue(QScriptValue::UndefinedValue);
 }
 
-HP15C::HP15C(int& argc, char *argv[])
- : QApplication(argc, argv)
+// Native special functions (specfun.h), installed as Native before
+// hp15c.js is loaded so that it can use them instead of its own.
+
+void set_overflow(QScriptEngine *engine)
 {
-    setWindowIcon(QIcon(":/15-128.png"));
+    engine->globalObject().property("Flags").setProperty(9, true);
+}
+
+template <double (*F)(double)>
+QScriptValue native_real(QScriptContext *context, QScriptEngine *engine)
+{
+    Q_UNUSED(engine);
+
+    return QScriptValue(F(context->argument(0).toNumber()));
+}
+
+QScriptValue native_factorial(QScriptContext *context, QScriptEngine *engine)
+{
+    bool overflow;
+    double r = specfun::factorial(context->argument(0).toNumber(), overflow);
+    if (overflow) {
+        set_overflow(engine);
+    }
+    return QScriptValue(r);
+}
+
+template <double (*F)(double, double, double)>
+QScriptValue native_drg(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValue global = engine->globalObject();
+    return QScriptValue(F(context->argument(0).toNumber(),
+                          global.property("FullCircle").toNumber(),
+                          global.property("TrigFactor").toNumber()));
+}
+
+QScriptValue native_tan_drg(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValue global = engine->globalObject();
+    bool overflow;
+    double r = specfun::tan_drg(context->argument(0).toNumber(),
+                                global.property("FullCircle").toNumber(),
+                                global.property("TrigFactor").toNumber(),
+                                overflow);
+    if (overflow) {
+        set_overflow(engine);
+    }
+    return QScriptValue(r);
+}
 
+// The complex functions are installed as methods of Complex, so the
+// argument is "this" and the result is a new Complex.
+specfun::complex this_complex(QScriptContext *context)
+{
+    QScriptValue z = context->thisObject();
+    return specfun::complex(z.property("re").toNumber(), z.property("im").toNumber());
+}
+
+QScriptValue new_complex(QScriptEngine *engine, const specfun::complex &z)
+{
+    QScriptValueList args;
+    args << z.real() << z.imag();
+    return engine->globalObject().property("Complex").construct(args);
+}
+
+template <specfun::complex (*F)(const specfun::complex &)>
+QScriptValue native_complex(QScriptContext *context, QScriptEngine *engine)
+{
+    return new_complex(engine, F(this_complex(context)));
+}
+
+template <specfun::complex (*F)(const specfun::complex &, bool &)>
+QScriptValue native_complex_overflow(QScriptContext *context, QScriptEngine *engine)
+{
+    bool overflow;
+    specfun::complex r = F(this_complex(context), overflow);
+    if (overflow) {
+        set_overflow(engine);
+    }
+    return new_complex(engine, r);
+}
+
+// The program virtual machine (vm.h), installed as Native.vm. hp15c.js
+// loads the program into it whenever the program has changed, and it runs
+// against a copy of the calculator state that is written back afterwards.
+
+vm::Program g_Program;
+
+QScriptValue vm_load(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValue lines = context->argument(0);
+    qint32 n = lines.property("length").toInt32();
+    std::vector<std::vector<int> > program(n);
+    for (qint32 i = 0; i < n; i++) {
+        QScriptValue keys = lines.property(i);
+        qint32 m = keys.property("length").toInt32();
+        for (qint32 j = 0; j < m; j++) {
+            program[i].push_back(keys.property(j).toInt32());
+        }
+    }
+    g_Program.load(program);
+
+    // which lines run() is worth calling at, so that the script need not
+    // call it only to find out
+    QScriptValue starts = engine->newArray(quint32(n + 1));
+    for (qint32 pc = 0; pc <= n; pc++) {
+        starts.setProperty(pc, g_Program.runs(pc));
+    }
+    return starts;
+}
+
+QScriptValue reg_property(const QScriptValue &reg, int r)
+{
+    return r == vm::REG_I ? reg.property("I") : reg.property(r);
+}
+
+// Copy the registers the program uses.
+void get_registers(const QScriptValue &global, vm::State &s)
+{
+    QScriptValue reg = global.property("Reg");
+    for (int r = 0; r < vm::REGS; r++) {
+        s.known[r] = false;
+        s.changed[r] = false;
+    }
+    const std::vector<int> &used = g_Program.registers();
+    for (size_t i = 0; i < used.size(); i++) {
+        QScriptValue x = reg_property(reg, used[i]);
+        s.known[used[i]] = x.isNumber();
+        s.reg[used[i]] = x.toNumber();
+    }
+}
+
+void put_registers(QScriptValue &global, const vm::State &s)
+{
+    QScriptValue reg = global.property("Reg");
+    const std::vector<int> &used = g_Program.registers();
+    for (size_t i = 0; i < used.size(); i++) {
+        int r = used[i];
+        if (s.changed[r]) {
+            if (r == vm::REG_I) {
+                reg.setProperty("I", s.reg[r]);
+            } else {
+                reg.setProperty(r, s.reg[r]);
+            }
+        }
+    }
+}
+
+// Copy the state a program runs against. Returns false when the stack
+// holds a matrix descriptor, which is left to the script.
+bool get_state(const QScriptValue &global, vm::State &s)
+{
+    QScriptValue stack = global.property("Stack");
+    QScriptValue stacki = global.property("StackI");
+    for (int i = 0; i < 4; i++) {
+        QScriptValue x = stack.property(i);
+        if (!x.isNumber()) {
+            return false;
+        }
+        s.stack[i] = x.toNumber();
+        s.stacki[i] = stacki.property(i).toNumber();
+    }
+    QScriptValue lastx = global.property("LastX");
+    s.lastx_known = lastx.isNumber();
+    s.lastx = lastx.toNumber();
+    s.lastxi = global.property("LastXI").toNumber();
+
+    get_registers(global, s);
+
+    QScriptValue flags = global.property("Flags");
+    for (int f = 0; f < vm::FLAGS; f++) {
+        s.flags[f] = flags.property(f).toBool();
+    }
+    QScriptValue returns = global.property("ReturnStack");
+    qint32 n = returns.property("length").toInt32();
+    for (qint32 i = 0; i < n; i++) {
+        s.returns.push_back(returns.property(i).toInt32());
+    }
+    s.stack_lift = global.property("StackLift").toBool();
+    s.digit_entry = global.property("DigitEntry").toBool();
+    s.pc = global.property("PC").toInt32();
+    s.running = global.property("Running").toBool();
+    return true;
+}
+
+void put_state(QScriptValue &global, const vm::State &s)
+{
+    QScriptValue stack = global.property("Stack");
+    QScriptValue stacki = global.property("StackI");
+    for (int i = 0; i < 4; i++) {
+        stack.setProperty(i, s.stack[i]);
+        stacki.setProperty(i, s.stacki[i]);
+    }
+    if (s.lastx_known) {
+        global.setProperty("LastX", s.lastx);
+        global.setProperty("LastXI", s.lastxi);
+    }
+
+    put_registers(global, s);
+
+    QScriptValue flags = global.property("Flags");
+    for (int f = 0; f < vm::FLAGS; f++) {
+        flags.setProperty(f, s.flags[f]);
+    }
+    QScriptValue returns = global.property("ReturnStack");
+    returns.setProperty("length", int(s.returns.size()));
+    for (size_t i = 0; i < s.returns.size(); i++) {
+        returns.setProperty(quint32(i), s.returns[i]);
+    }
+    global.setProperty("StackLift", s.stack_lift);
+    global.setProperty("DigitEntry", s.digit_entry);
+    if (s.digit_entry) {
+        global.setProperty("Entry", QString::fromStdString(s.entry));
+    }
+    global.setProperty("PC", s.pc);
+    global.setProperty("Running", s.running);
+}
+
+QScriptValue vm_run(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValue global = engine->globalObject();
+
+    // don't copy the state when the first line is left to the script
+    if (!g_Program.runs(global.property("PC").toInt32())) {
+        return QScriptValue(0);
+    }
+    vm::State s;
+    if (!get_state(global, s)) {
+        return QScriptValue(0);
+    }
+    int lines = g_Program.run(s, context->argument(0).toInt32(), context->argument(1).toInt32());
+    if (lines > 0) {
+        put_state(global, s);
+    }
+    return QScriptValue(lines);
+}
+
+// Evaluate a subroutine without branches for each of an array of values
+// (see vm::Kernel). Returns null when the script has to call it for each
+// one instead.
+QScriptValue vm_map(QScriptContext *context, QScriptEngine *engine)
+{
+    QScriptValue global = engine->globalObject();
+    vm::Kernel kernel;
+    if (!g_Program.kernel(global.property("PC").toInt32(), context->argument(0).toInt32(), kernel)) {
+        return QScriptValue(QScriptValue::NullValue);
+    }
+    QScriptValue array = context->argument(1);
+    quint32 n = array.property("length").toUInt32();
+    std::vector<double> values(n);
+    for (quint32 i = 0; i < n; i++) {
+        values[i] = array.property(i).toNumber();
+    }
+    vm::State s;
+    get_registers(global, s);
+    if (!kernel.map(values, s)) {
+        return QScriptValue(QScriptValue::NullValue);
+    }
+    put_registers(global, s);
+
+    QScriptValue results = engine->newArray(n);
+    for (quint32 i = 0; i < n; i++) {
+        results.setProperty(i, values[i]);
+    }
+    return results;
+}
+
+// Create the script engine with the native functions and load hp15c.js.
+void load_scripts()
+{
     script = new QScriptEngine();
     script->globalObject().setProperty("alert", script->newFunction(mylert));
 
+    QScriptValue native = script->newObject();
+    native.setProperty("gamma", script->newFunction(native_real<specfun::gamma>));
+    native.setProperty("factorial", script->newFunction(native_factorial));
+    native.setProperty("sinh", script->newFunction(native_real<specfun::sinh>));
+    native.setProperty("cosh", script->newFunction(native_real<specfun::cosh>));
+    native.setProperty("tanh", script->newFunction(native_real<specfun::tanh>));
+    native.setProperty("asinh", script->newFunction(native_real<specfun::asinh>));
+    native.setProperty("acosh", script->newFunction(native_real<specfun::acosh>));
+    native.setProperty("atanh", script->newFunction(native_real<specfun::atanh>));
+    native.setProperty("sin_drg_mode", script->newFunction(native_drg<specfun::sin_drg>));
+    native.setProperty("cos_drg_mode", script->newFunction(native_drg<specfun::cos_drg>));
+    native.setProperty("tan_drg_mode", script->newFunction(native_tan_drg));
+    QScriptValue complex = script->newObject();
+    complex.setProperty("sin", script->newFunction(native_complex<specfun::sin>));
+    complex.setProperty("cos", script->newFunction(native_complex<specfun::cos>));
+    complex.setProperty("tan", script->newFunction(native_complex<specfun::tan>));
+    complex.setProperty("sinh", script->newFunction(native_complex<specfun::sinh>));
+    complex.setProperty("cosh", script->newFunction(native_complex<specfun::cosh>));
+    complex.setProperty("tanh", script->newFunction(native_complex<specfun::tanh>));
+    complex.setProperty("asin", script->newFunction(native_complex<specfun::asin>));
+    complex.setProperty("acos", script->newFunction(native_complex<specfun::acos>));
+    complex.setProperty("atan", script->newFunction(native_complex_overflow<specfun::atan>));
+    complex.setProperty("asinh", script->newFunction(native_complex<specfun::asinh>));
+    complex.setProperty("acosh", script->newFunction(native_complex<specfun::acosh>));
+    complex.setProperty("atanh", script->newFunction(native_complex_overflow<specfun::atanh>));
+    native.setProperty("complex", complex);
+    QScriptValue vm = script->newObject();
+    vm.setProperty("load", script->newFunction(vm_load));
+    vm.setProperty("run", script->newFunction(vm_run));
+    vm.setProperty("map", script->newFunction(vm_map));
+    native.setProperty("vm", vm);
+    script->globalObject().setProperty("Native", native);
+
+    // matrix.js is loaded on first use of a matrix and test.js the first
+    // time the tests are run
+    script->globalObject().setProperty("RequireMatrix", script->newFunction(RequireMatrix));
+
     load(":/sprintf-0.6.js");
-    load(":/matrix.js");
     load(":/hp15c.js");
-    load(":/test.js");
+}
+
+HP15C::HP15C(int& argc, char *argv[])
+ : QApplication(argc, argv)
+{
+    setWindowIcon(QIcon(":/15-128.png"));
+
+    load_scripts();
 }
 
 void HP15C::init()
@@ -650,20 +1078,48 @@ void HP15C::init()
     script->evaluate("init()");
 }
 
-void HP15C::load(const QString &fn)
+// Run the benchmark suite without showing any window and print the JSON
+// report; see bench.js for the accepted arguments.
+int bench(const QStringList &args)
 {
-    QFile f(fn);
-    if (!f.open(QIODevice::ReadOnly)) {
-        QMessageBox::warning(NULL, "file not found", fn);
+    script->globalObject().setProperty("alert", script->newFunction(warn));
+    script->globalObject().setProperty("setTimeout", script->newFunction(setTimeout));
+    script->globalObject().setProperty("clearTimeout", script->newFunction(clearTimeout));
+    script->globalObject().setProperty("setInterval", script->newFunction(setInterval));
+    script->globalObject().setProperty("clearInterval", script->newFunction(clearInterval));
+    script->globalObject().setProperty("print", script->newFunction(print));
+    script->globalObject().setProperty("readFile", script->newFunction(readFile));
+    script->globalObject().setProperty("bench_now", script->newFunction(bench_now));
+
+    require(":/bench.js");
+
+    QScriptValueList bargs;
+    bargs << script->toScriptValue(args);
+    QScriptValue r = script->evaluate("bench_main").call(QScriptValue(), bargs);
+    if (r.isError()) {
+        fputs(qPrintable(r.toString() + "\n"), stderr);
+        return 2;
     }
-    QScriptValue r = script->evaluate(f.readAll());
-    f.close();
-    checkError(r);
+    fputs(qPrintable(r.toString() + "\n"), stdout);
+    return script->evaluate("BenchRegressions").toInt32() > 0 ? 1 : 0;
 }
 
 int main(int argc, char **argv)
 {
+    g_StartupClock.start();
+    g_StartupTrace = !qgetenv("HP15C_STARTUP_TRACE").isEmpty();
+    startup_trace("process start");
+
+    // hp15c --bench [--warmup=N] [--reps=N] [--filter=REGEX] [--baseline=FILE] ...
+    // This shows no window, so it runs without a display server too.
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        QCoreApplication a(argc, argv);
+        load_scripts();
+        return bench(a.arguments().mid(2));
+    }
+
     HP15C a(argc, argv);
+    startup_trace("scripts loaded");
 
     QMainWindow mainwin;
     mainwin.setWindowTitle("HP 15C");
@@ -688,6 +1144,7 @@ int main(int argc, char **argv)
     QWidget holder(&mainwin);
     CalcWidget *calc = new CalcWidget(&holder);
     mainwin.setCentralWidget(&holder);
+    startup_trace("widgets created");
 
     QObject::connect(copyaction, SIGNAL(triggered()), calc, SLOT(copy()));
     QObject::connect(pasteaction, SIGNAL(triggered()), calc, SLOT(paste()));
@@ -696,10 +1153,12 @@ int main(int argc, char **argv)
     QObject::connect(aboutaction, SIGNAL(triggered()), calc, SLOT(about()));
 
     a.init();
+    startup_trace("engine initialized");
 
     g_CalcWidget->set_full_keys(true);
 
     mainwin.show();
+    startup_trace("window shown");
 
     // set the final size after showing the window
     g_CalcWidget->set_full_keys(true);
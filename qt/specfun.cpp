@@ -0,0 +1,308 @@
+#include "specfun.h"
+
+#include <cmath>             // for exp, pow, sqrt, log, atan2, fmod, floor, ...
+
+namespace specfun {
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Spouge's approximation with a = 12, as in hp15c.js.
+// https://en.wikipedia.org/wiki/Spouge's_approximation
+const int SPOUGE_A = 12;
+
+// Everything that the script version recomputes on each call is worked out
+// once, the first time any of these functions is used.
+struct Tables {
+    double spouge[SPOUGE_A];
+    double fact[70];
+
+    Tables()
+    {
+        double kf = 1.0;
+        spouge[0] = std::sqrt(2.0 * PI);
+        for (int k = 1; k < SPOUGE_A; k++) {
+            spouge[k] = std::exp(SPOUGE_A - k) * std::pow(double(SPOUGE_A - k), k - 0.5) / kf;
+            kf *= -k;
+        }
+        // multiply in the same order as the script so that the results
+        // are identical
+        for (int n = 0; n < 70; n++) {
+            double r = 1;
+            for (double x = n; x > 1; x -= 1) {
+                r *= x;
+            }
+            fact[n] = r;
+        }
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables t;
+    return t;
+}
+
+double sign(double x)
+{
+    if (x == 0) {
+        return 0;
+    }
+    return x > 0 ? 1 : -1;
+}
+
+// asinh, written the way hp15c.js does it
+double log_hyp(double x)
+{
+    return sign(x) * std::log(std::fabs(x) + std::sqrt(x*x + 1));
+}
+
+// The complex helpers below follow Complex in hp15c.js rather than
+// std::complex, so that both give the same answers for the same input.
+complex csqrt(const complex &z)
+{
+    double a = std::sqrt(z.real()*z.real() + z.imag()*z.imag());
+    return complex(std::sqrt((z.real() + a) / 2), (z.imag() < 0 ? -1 : 1) * std::sqrt((-z.real() + a) / 2));
+}
+
+complex cdiv(const complex &a, const complex &b)
+{
+    double d = b.real()*b.real() + b.imag()*b.imag();
+    return complex((a.real()*b.real() + a.imag()*b.imag()) / d, (a.imag()*b.real() - a.real()*b.imag()) / d);
+}
+
+complex clog(const complex &z)
+{
+    return complex(std::log(z.real()*z.real() + z.imag()*z.imag()) / 2, std::atan2(z.imag(), z.real()));
+}
+
+// Which quarter of a full circle x is an exact multiple of, or -1.
+int quarter(double x, double full_circle)
+{
+    if (full_circle != 360 && full_circle != 400) {
+        return -1;
+    }
+    double q = std::fmod(x, full_circle) / (full_circle / 4);
+    if (q != std::floor(q)) {
+        return -1;
+    }
+    return (int(q) + 4) % 4;
+}
+
+// Reduce x to less than a full circle before converting to radians, so
+// that large arguments in DEG and GRAD mode do not lose precision.
+double to_radians(double x, double full_circle, double trig_factor)
+{
+    if (full_circle == 360 || full_circle == 400) {
+        x = std::fmod(x, full_circle);
+    }
+    return x * trig_factor;
+}
+
+} // namespace
+
+double gamma(double z)
+{
+    const Tables &t = tables();
+    double acc = t.spouge[0];
+    for (int k = 1; k < SPOUGE_A; k++) {
+        acc += t.spouge[k] / (z + k);
+    }
+    acc *= std::exp(-(z + SPOUGE_A)) * std::pow(z + SPOUGE_A, z + 0.5);
+    return acc / z;
+}
+
+double factorial(double x, bool &overflow)
+{
+    overflow = false;
+    if (x >= 0 && x == std::floor(x)) {
+        if (x > 69) {
+            overflow = true;
+            return MAX;
+        }
+        return tables().fact[int(x)];
+    }
+    x += 1;
+    if (x <= 0 && x == std::floor(x)) {
+        overflow = true;
+        return -MAX;
+    }
+    if (x < -70.06400563) {
+        return 0;
+    }
+    if (x > 70.95757445) {
+        overflow = true;
+        return MAX;
+    }
+    if (x >= -10) {
+        return gamma(x);
+    }
+    return PI / (gamma(1 - x) * std::sin(PI * x));
+}
+
+double sinh(double x)
+{
+    return std::sinh(x);
+}
+
+double cosh(double x)
+{
+    return std::cosh(x);
+}
+
+double tanh(double x)
+{
+    return std::tanh(x);
+}
+
+// std::asinh and friends are C++11, which the Windows build does not have.
+double asinh(double x)
+{
+    return log_hyp(x);
+}
+
+double acosh(double x)
+{
+    return std::log(x + std::sqrt(x*x - 1));
+}
+
+double atanh(double x)
+{
+    return std::log((1 + x) / (1 - x)) / 2;
+}
+
+double sin_drg(double x, double full_circle, double trig_factor)
+{
+    switch (quarter(x, full_circle)) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return 0;
+        case 3: return -1;
+    }
+    return std::sin(to_radians(x, full_circle, trig_factor));
+}
+
+double cos_drg(double x, double full_circle, double trig_factor)
+{
+    switch (quarter(x, full_circle)) {
+        case 0: return 1;
+        case 1: return 0;
+        case 2: return -1;
+        case 3: return 0;
+    }
+    return std::cos(to_radians(x, full_circle, trig_factor));
+}
+
+double tan_drg(double x, double full_circle, double trig_factor, bool &overflow)
+{
+    overflow = false;
+    switch (quarter(x, full_circle)) {
+        case 0:
+        case 2:
+            return 0;
+        case 1:
+        case 3:
+            overflow = true;
+            return MAX;
+    }
+    return std::tan(to_radians(x, full_circle, trig_factor));
+}
+
+complex sin(const complex &z)
+{
+    return complex(std::sin(z.real())*std::cosh(z.imag()), std::cos(z.real())*std::sinh(z.imag()));
+}
+
+complex cos(const complex &z)
+{
+    return complex(std::cos(z.real())*std::cosh(z.imag()), -std::sin(z.real())*std::sinh(z.imag()));
+}
+
+complex tan(const complex &z)
+{
+    complex u(std::tan(z.real()), std::tanh(z.imag()));
+    return cdiv(u, complex(1, -u.real()*u.imag()));
+}
+
+complex sinh(const complex &z)
+{
+    return complex(std::sinh(z.real())*std::cos(z.imag()), std::cosh(z.real())*std::sin(z.imag()));
+}
+
+complex cosh(const complex &z)
+{
+    return complex(std::cosh(z.real())*std::cos(z.imag()), std::sinh(z.real())*std::sin(z.imag()));
+}
+
+complex tanh(const complex &z)
+{
+    complex u(std::tanh(z.real()), std::tan(z.imag()));
+    return cdiv(u, complex(1, u.real()*u.imag()));
+}
+
+complex asin(const complex &z)
+{
+    complex s1 = csqrt(complex(1 + z.real(), z.imag()));
+    complex s2 = csqrt(complex(1 - z.real(), -z.imag()));
+    double r1 = log_hyp(s1.real()*s2.imag() - s2.real()*s1.imag());
+    double i1 = std::atan2(z.real(), s1.real()*s2.real() - s1.imag()*s2.imag());
+    return complex(i1, -r1);
+}
+
+complex acos(const complex &z)
+{
+    complex s1 = csqrt(complex(1 - z.real(), -z.imag()));
+    complex s2 = csqrt(complex(1 + z.real(), z.imag()));
+    double r1 = 2 * std::atan2(s1.real(), s2.real());
+    double i1 = log_hyp(s2.real()*s1.imag() - s2.imag()*s1.real());
+    return complex(r1, i1);
+}
+
+complex atan(const complex &z, bool &overflow)
+{
+    overflow = false;
+    if (z.real() == 0 && std::fabs(z.imag()) == 1) {
+        overflow = true;
+        return complex(0, sign(z.imag()) * MAX);
+    }
+    double rsign = 1;
+    if (z.real() == 0 && std::fabs(z.imag()) > 1) {
+        rsign = -1;
+    }
+    complex i(0, 1);
+    complex w = clog(cdiv(i + z, i - z));
+    return complex(rsign * -w.imag()/2, w.real()/2);
+}
+
+complex asinh(const complex &z)
+{
+    complex s1 = csqrt(complex(1 + z.imag(), -z.real()));
+    complex s2 = csqrt(complex(1 - z.imag(), z.real()));
+    double r1 = log_hyp(s1.real()*s2.imag() - s2.real()*s1.imag());
+    double i1 = std::atan2(z.imag(), s1.real()*s2.real() - s1.imag()*s2.imag());
+    return complex(r1, i1);
+}
+
+complex acosh(const complex &z)
+{
+    complex s1 = csqrt(complex(z.real() - 1, z.imag()));
+    complex s2 = csqrt(complex(z.real() + 1, z.imag()));
+    double r1 = log_hyp(s1.real()*s2.real() + s1.imag()*s2.imag());
+    double i1 = 2 * std::atan2(s1.imag(), s2.real());
+    return complex(r1, i1);
+}
+
+complex atanh(const complex &z, bool &overflow)
+{
+    overflow = false;
+    if (z.imag() == 0 && std::fabs(z.real()) == 1) {
+        overflow = true;
+        return complex(sign(z.real()) * MAX, 0);
+    }
+    complex one(1, 0);
+    complex u = clog(cdiv(one + z, one - z));
+    return complex(u.real()/2, u.imag()/2);
+}
+
+} // namespace specfun
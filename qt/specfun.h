@@ -0,0 +1,50 @@
+#ifndef SPECFUN_H
+#define SPECFUN_H
+
+#include <complex>           // for complex
+
+// Native versions of the special functions in hp15c.js. Each one returns
+// the same result as its script counterpart (sinh(), factorial(),
+// sin_drg_mode(), Complex.sin(), ...) up to rounding, and reports the
+// cases where the script version sets flag 9 through "overflow".
+
+namespace specfun {
+
+typedef std::complex<double> complex;
+
+// The largest number the calculator can display.
+const double MAX = 9.999999999e99;
+
+double gamma(double z);
+double factorial(double x, bool &overflow);
+
+double sinh(double x);
+double cosh(double x);
+double tanh(double x);
+double asinh(double x);
+double acosh(double x);
+double atanh(double x);
+
+// Trigonometric functions in the current angle mode, where full_circle is
+// 360 (DEG), 400 (GRAD) or 2 pi (RAD) and trig_factor converts to radians.
+// Multiples of a quarter circle give exact results in DEG and GRAD mode.
+double sin_drg(double x, double full_circle, double trig_factor);
+double cos_drg(double x, double full_circle, double trig_factor);
+double tan_drg(double x, double full_circle, double trig_factor, bool &overflow);
+
+complex sin(const complex &z);
+complex cos(const complex &z);
+complex tan(const complex &z);
+complex sinh(const complex &z);
+complex cosh(const complex &z);
+complex tanh(const complex &z);
+complex asin(const complex &z);
+complex acos(const complex &z);
+complex atan(const complex &z, bool &overflow);
+complex asinh(const complex &z);
+complex acosh(const complex &z);
+complex atanh(const complex &z, bool &overflow);
+
+} // namespace specfun
+
+#endif // SPECFUN_H
@@ -0,0 +1,1198 @@
+#include "vm.h"
+
+#include <clocale>           // for localeconv
+#include <cmath>             // for floor, fabs, sqrt, exp, log, pow, HUGE_VAL
+#include <cstdio>            // for sprintf
+#include <cstdlib>           // for strtod
+
+namespace vm {
+
+namespace {
+
+// Instructions. Each one does exactly what the script does for the same
+// line, or leaves the state alone and hands the line to the script.
+enum Op {
+    FALLBACK,       // left to the script
+    END,            // past the last line, which returns
+    NOP,            // LBL
+    NUMBER,         // a run of digit entry lines
+    ENTER,
+    CLX,
+    LASTX,
+    ROLL,
+    ROLLUP,
+    XY,
+    CHS,
+    PI,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    POW,
+    SQRT,
+    SQUARE,
+    INV,
+    ABS,
+    EXP,
+    LN,
+    EXP10,
+    LOG,
+    INT,
+    FRAC,
+    STO,
+    STO_OP,
+    RCL,
+    RCL_OP,
+    DSE,
+    ISG,
+    GTO,
+    GSB,
+    RTN,
+    TEST,
+    SF,
+    CF,
+    FTEST,
+
+    // superinstructions, made from the instruction above and the line
+    // after it
+    RCL_ARITH,      // RCL followed by + - * or /
+    DSE_GTO,
+    ISG_GTO,
+    TEST_GTO,
+
+    OPS
+};
+
+// Register operand for (i).
+const int IND = 255;
+
+// TEST numbers for x<=y and x=0, after g TEST 0-9.
+const int TEST_LE = 10;
+const int TEST_EQ0 = 11;
+
+// run() is not worth starting for fewer lines than this, unless they jump.
+const int MIN_LINES = 4;
+
+// Lines counted for a stretch that jumps, which is likely to be a loop.
+const int LOOP_LINES = 1000;
+
+const double PI_VALUE = 3.141592653589793;
+const double LN10 = 2.302585092994046;
+
+bool finite(double x)
+{
+    // the same as the isNaN() and Infinity checks in unop() and binop()
+    return x == x && x != HUGE_VAL && x != -HUGE_VAL;
+}
+
+double trunc(double x)
+{
+    if (x < 0) {
+        return -std::floor(-x);
+    }
+    return std::floor(x);
+}
+
+// Keycodes of + - * and / are also used to name the operator of STO and
+// RCL arithmetic.
+double arith(int op, double y, double x)
+{
+    switch (op) {
+        case 10: return y / x;
+        case 20: return y * x;
+        case 30: return y - x;
+    }
+    return y + x;
+}
+
+bool is_arith(int k)
+{
+    return k == 10 || k == 20 || k == 30 || k == 40;
+}
+
+// The instruction for the keycode of + - * or /.
+int arith_op(int k)
+{
+    switch (k) {
+        case 10: return DIV;
+        case 20: return MUL;
+        case 30: return SUB;
+    }
+    return ADD;
+}
+
+bool is_digit(const std::vector<int> &k)
+{
+    return k.size() == 1 && ((k[0] >= 0 && k[0] <= 9) || k[0] == 48 || k[0] == 26);
+}
+
+bool is_chs(const std::vector<int> &k)
+{
+    return k.size() == 1 && k[0] == 16;
+}
+
+bool is_label(const std::vector<int> &k, int label)
+{
+    return k.size() == 3 && k[0] == 42 && k[1] == 21 && k[2] == label;
+}
+
+// Register operand of STO, RCL, DSE and ISG: 0-9 and .0-.9, (i) or I.
+int reg_operand(int k)
+{
+    if (k >= 0 && k <= 19) {
+        return k;
+    }
+    if (k == 24) {
+        return IND;
+    }
+    if (k == 25) {
+        return REG_I;
+    }
+    return -1;
+}
+
+// The register an operand refers to, following (i) through register I the
+// way op_sto_index() does. Returns -1 when that is left to the script.
+int reg_index(const State &s, int a)
+{
+    if (a != IND) {
+        return s.known[a] ? a : -1;
+    }
+    if (!s.known[REG_I]) {
+        return -1;
+    }
+    double i = std::floor(std::fabs(s.reg[REG_I]));
+    if (!(i >= 0 && i < REG_I)) {
+        return -1;
+    }
+    return s.known[int(i)] ? int(i) : -1;
+}
+
+void push(State &s, double x)
+{
+    if (s.stack_lift) {
+        s.stack[3] = s.stack[2]; s.stacki[3] = s.stacki[2];
+        s.stack[2] = s.stack[1]; s.stacki[2] = s.stacki[1];
+        s.stack[1] = s.stack[0]; s.stacki[1] = s.stacki[0];
+    }
+    s.stack[0] = x;
+    s.stacki[0] = 0;
+}
+
+void drop(State &s)
+{
+    s.stack[1] = s.stack[2]; s.stacki[1] = s.stacki[2];
+    s.stack[2] = s.stack[3]; s.stacki[2] = s.stacki[3];
+}
+
+// DSE and ISG, as op_dse() and op_isg(). Returns false when the counter is
+// one whose decoding is left to the script: a negative fraction, or one
+// that sprintf() might round differently from the script's sprintf().
+bool loop_counter(State &s, int r, bool increment, bool &skip)
+{
+    double n = trunc(s.reg[r]);
+    double f = s.reg[r] - n;
+    double t = f * 1e5;
+    if (f < 0 || std::fabs(t - std::floor(t) - 0.5) < 1e-6) {
+        return false;
+    }
+    char buf[32];
+    std::sprintf(buf, "%.5f", f);
+    int x = (buf[2] - '0') * 100 + (buf[3] - '0') * 10 + (buf[4] - '0');
+    int y = (buf[5] - '0') * 10 + (buf[6] - '0');
+    if (y == 0) {
+        y = 1;
+    }
+    if (increment) {
+        n += y;
+        skip = n > x;
+    } else {
+        n -= y;
+        skip = n <= x;
+    }
+    s.reg[r] = n + f;
+    s.changed[r] = true;
+    return true;
+}
+
+// push() for the slots Program::kernel() keeps in each stack register.
+void push_slot(int *stack, int slot, bool lift)
+{
+    if (lift) {
+        stack[3] = stack[2];
+        stack[2] = stack[1];
+        stack[1] = stack[0];
+    }
+    stack[0] = slot;
+}
+
+bool all_finite(const double *x, size_t n)
+{
+    bool ok = true;
+    for (size_t j = 0; j < n; j++) {
+        ok &= finite(x[j]);
+    }
+    return ok;
+}
+
+bool test(const State &s, int t)
+{
+    double x = s.stack[0];
+    double y = s.stack[1];
+    switch (t) {
+        case 0: return x != 0;
+        case 1: return x  > 0;
+        case 2: return x  < 0;
+        case 3: return x >= 0;
+        case 4: return x <= 0;
+        case 5: return x == y;
+        case 6: return x != y;
+        case 7: return x  > y;
+        case 8: return x  < y;
+        case 9: return x >= y;
+        case TEST_LE: return x <= y;
+        case TEST_EQ0: return x == 0;
+    }
+    return false;
+}
+
+} // namespace
+
+Program::Program()
+    : size(0)
+{
+    std::vector<std::vector<int> > none;
+    load(none);
+}
+
+void Program::load(const std::vector<std::vector<int> > &lines)
+{
+    size = int(lines.size());
+    keys.assign(1, std::vector<int>());
+    keys.insert(keys.end(), lines.begin(), lines.end());
+    numbers.clear();
+    entries.clear();
+
+    // two END instructions, so that skipping the last line needs no check
+    code.assign(size + 3, Instr());
+    for (int p = 0; p < int(code.size()); p++) {
+        code[p].op = p > size ? END : FALLBACK;
+    }
+
+    int p = 1;
+    while (p <= size) {
+        if (is_digit(keys[p])) {
+            p += translate_number(p);
+        } else {
+            code[p] = translate(p);
+            p++;
+        }
+    }
+    for (p = 1; p < size; p++) {
+        fuse(p);
+    }
+
+    stretch.assign(size + 3, 0);
+    for (p = size; p >= 1; p--) {
+        int lines = 1;
+        switch (code[p].op) {
+            case FALLBACK:
+                continue;
+            case GTO:
+            case GSB:
+            case DSE_GTO:
+            case ISG_GTO:
+            case TEST_GTO:
+                stretch[p] = LOOP_LINES;
+                continue;
+            case RTN:
+                stretch[p] = 1;
+                continue;
+            case NUMBER:
+                lines = code[p].a;
+                break;
+            case RCL_ARITH:
+                lines = 2;
+                break;
+        }
+        stretch[p] = lines + stretch[p + lines];
+    }
+
+    regs.clear();
+    bool used[REGS] = {false};
+    for (p = 1; p <= size; p++) {
+        switch (code[p].op) {
+            case STO:
+            case STO_OP:
+            case RCL:
+            case RCL_OP:
+            case DSE:
+            case ISG:
+            case RCL_ARITH:
+            case DSE_GTO:
+            case ISG_GTO:
+                if (code[p].a == IND) {
+                    for (int r = 0; r < REGS; r++) {
+                        used[r] = true;
+                    }
+                } else {
+                    used[code[p].a] = true;
+                }
+                break;
+        }
+    }
+    for (int r = 0; r < REGS; r++) {
+        if (used[r]) {
+            regs.push_back(r);
+        }
+    }
+}
+
+bool Program::runs(int pc) const
+{
+    if (pc == 0) {
+        pc = 1;
+    }
+    return pc <= size && stretch[pc] >= MIN_LINES;
+}
+
+const std::vector<int> &Program::registers() const
+{
+    return regs;
+}
+
+// The line GTO label on line jumps to, found the way op_gto_label() finds
+// it, or -1 when there is no such label.
+int Program::label_line(int line, int label) const
+{
+    int pc = line + 1;
+    int p = pc + 1;
+    for (int i = 0; i <= size + 2; i++) {
+        if (p >= size + 1) {
+            p = 0;
+        } else if (is_label(keys[p], label)) {
+            return p;
+        }
+        if (p == pc) {
+            break;
+        }
+        p++;
+    }
+    return -1;
+}
+
+Program::Instr Program::translate(int line) const
+{
+    const std::vector<int> &k = keys[line];
+    Instr i = Instr();
+    i.op = FALLBACK;
+    switch (k.size()) {
+        case 1:
+            switch (k[0]) {
+                case 10: i.op = DIV; break;
+                case 11: i.op = SQRT; break;
+                case 12: i.op = EXP; break;
+                case 13: i.op = EXP10; break;
+                case 14: i.op = POW; break;
+                case 15: i.op = INV; break;
+                case 16: i.op = CHS; break;
+                case 20: i.op = MUL; break;
+                case 30: i.op = SUB; break;
+                case 33: i.op = ROLL; break;
+                case 34: i.op = XY; break;
+                case 36: i.op = ENTER; break;
+                case 40: i.op = ADD; break;
+            }
+            break;
+        case 2:
+            if (k[0] == 42 && k[1] == 44) {
+                i.op = FRAC;
+            } else if (k[0] == 43) {
+                switch (k[1]) {
+                    case 10: i.op = TEST; i.a = TEST_LE; break;
+                    case 11: i.op = SQUARE; break;
+                    case 12: i.op = LN; break;
+                    case 13: i.op = LOG; break;
+                    case 16: i.op = ABS; break;
+                    case 20: i.op = TEST; i.a = TEST_EQ0; break;
+                    case 26: i.op = PI; break;
+                    case 32: i.op = RTN; break;
+                    case 33: i.op = ROLLUP; break;
+                    case 35: i.op = CLX; break;
+                    case 36: i.op = LASTX; break;
+                    case 44: i.op = INT; break;
+                }
+            } else if (k[0] == 44 || k[0] == 45) {
+                int r = reg_operand(k[1]);
+                if (r >= 0) {
+                    i.op = k[0] == 44 ? STO : RCL;
+                    i.a = r;
+                }
+            } else if ((k[0] == 22 || k[0] == 32) && k[1] != 25) {
+                i.target = label_line(line, k[1]);
+                if (i.target > 0) {
+                    i.op = k[0] == 22 ? GTO : GSB;
+                }
+            }
+            break;
+        case 3:
+            if (k[0] == 42 && k[1] == 21) {
+                i.op = NOP;
+            } else if (k[0] == 42 && (k[1] == 5 || k[1] == 6)) {
+                int r = reg_operand(k[2]);
+                if (r >= 0) {
+                    i.op = k[1] == 5 ? DSE : ISG;
+                    i.a = r;
+                }
+            } else if (k[0] == 43 && k[1] == 30 && k[2] >= 0 && k[2] <= 9) {
+                i.op = TEST;
+                i.a = k[2];
+            } else if (k[0] == 43 && k[1] >= 4 && k[1] <= 6 && k[2] >= 0 && k[2] < FLAGS) {
+                i.op = k[1] == 4 ? SF : k[1] == 5 ? CF : FTEST;
+                i.a = k[2];
+            } else if ((k[0] == 44 || k[0] == 45) && is_arith(k[1])) {
+                int r = reg_operand(k[2]);
+                if (r >= 0) {
+                    i.op = k[0] == 44 ? STO_OP : RCL_OP;
+                    i.a = r;
+                    i.b = k[1];
+                }
+            }
+            break;
+    }
+    return i;
+}
+
+// Digit entry lines, with any CHS among them, become a single NUMBER
+// instruction that leaves the same Entry and X that op_input() and
+// op_chs() would. The lines after the first are left to the script, which
+// is only ever asked to run them when a test skips into the number.
+// Returns the number of lines translated.
+int Program::translate_number(int line)
+{
+    int end = line;
+    while (end + 1 <= size && (is_digit(keys[end + 1]) || is_chs(keys[end + 1]))) {
+        end++;
+    }
+    int count = end - line + 1;
+
+    std::string entry;
+    for (int p = line; p <= end; p++) {
+        int k = keys[p][0];
+        if (k == 16) {
+            std::string::size_type e = entry.find('e');
+            if (e != std::string::npos) {
+                if (e + 1 < entry.size() && entry[e + 1] == '-') {
+                    entry.erase(e + 1, 1);
+                } else {
+                    entry.insert(e + 1, "-");
+                }
+            } else if (entry[0] == '-') {
+                entry.erase(0, 1);
+            } else {
+                entry.insert(0, "-");
+            }
+        } else {
+            char c = k == 48 ? '.' : k == 26 ? 'e' : char('0' + k);
+            if (entry.empty()) {
+                if (c == 'e') {
+                    entry = "1";
+                } else if (c == '.') {
+                    entry = "0";
+                }
+            }
+            entry += c;
+        }
+        if (entry[entry.size() - 1] == 'e') {
+            entry += "0";
+        }
+    }
+
+    // strtod() expects the decimal point of the current locale, which Qt
+    // sets from the environment, so the point is replaced with that one.
+    // Entries such as "1.2.3" are left to the script, which makes NaN of
+    // them where strtod() would stop at the second point.
+    std::string text = entry;
+    std::string::size_type point = text.find('.');
+    if (point != std::string::npos) {
+        text.replace(point, 1, std::localeconv()->decimal_point);
+    }
+    char *rest;
+    double x = std::strtod(text.c_str(), &rest);
+    if (*rest == '\0' && count <= 255) {
+        code[line].op = NUMBER;
+        code[line].a = count;
+        code[line].target = int(numbers.size());
+        numbers.push_back(x);
+        entries.push_back(entry);
+    }
+    return count;
+}
+
+void Program::fuse(int line)
+{
+    Instr &i = code[line];
+    const Instr &next = code[line + 1];
+    switch (i.op) {
+        case RCL:
+            switch (next.op) {
+                case ADD: i.b = 40; break;
+                case SUB: i.b = 30; break;
+                case MUL: i.b = 20; break;
+                case DIV: i.b = 10; break;
+                default: return;
+            }
+            i.op = RCL_ARITH;
+            break;
+        case DSE:
+        case ISG:
+        case TEST:
+            if (next.op == GTO) {
+                i.op = i.op == DSE ? DSE_GTO : i.op == ISG ? ISG_GTO : TEST_GTO;
+                i.target = next.target;
+            }
+            break;
+    }
+}
+
+// GCC and Clang can jump from each instruction straight to the next one
+// through a table of label addresses, which the branch predictor copes with
+// better than one shared switch. Other compilers use the switch alone.
+#if defined(__GNUC__)
+#define VM_THREADED
+#endif
+
+#ifdef VM_THREADED
+#define TARGET(op) case op: L_##op
+#define DISPATCH() { insn = &code[s.pc]; goto *targets[insn->op]; }
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+#endif
+
+// Finish an instruction that ran n lines and go on to the next one.
+#define NEXT(n) { lines += (n); if (lines >= limit) goto done; DISPATCH(); }
+
+// Leave the current instruction to the script.
+#define FALL_BACK() goto done
+
+int Program::run(State &s, int depth, int limit) const
+{
+#ifdef VM_THREADED
+    // in the same order as enum Op
+    static void *const targets[OPS] = {
+        &&L_FALLBACK, &&L_END, &&L_NOP, &&L_NUMBER, &&L_ENTER, &&L_CLX,
+        &&L_LASTX, &&L_ROLL, &&L_ROLLUP, &&L_XY, &&L_CHS, &&L_PI, &&L_ADD,
+        &&L_SUB, &&L_MUL, &&L_DIV, &&L_POW, &&L_SQRT, &&L_SQUARE, &&L_INV,
+        &&L_ABS, &&L_EXP, &&L_LN, &&L_EXP10, &&L_LOG, &&L_INT, &&L_FRAC,
+        &&L_STO, &&L_STO_OP, &&L_RCL, &&L_RCL_OP, &&L_DSE, &&L_ISG, &&L_GTO,
+        &&L_GSB, &&L_RTN, &&L_TEST, &&L_SF, &&L_CF, &&L_FTEST, &&L_RCL_ARITH,
+        &&L_DSE_GTO, &&L_ISG_GTO, &&L_TEST_GTO
+    };
+#endif
+    if (!s.running || s.digit_entry) {
+        return 0;
+    }
+    if (s.pc == 0) {
+        s.pc = 1;
+    } else if (s.pc > size + 1) {
+        s.pc = size + 1;
+    }
+
+    int lines = 0;
+    const Instr *insn;
+    double x;
+    int r;
+    bool skip = false;
+    for (;;) {
+        insn = &code[s.pc];
+        switch (insn->op) {
+        TARGET(FALLBACK):
+            FALL_BACK();
+
+        TARGET(END):
+        TARGET(RTN):
+            // running off the end returns without the bookkeeping that
+            // Opcode.exec() does for a RTN line
+            if (insn->op == RTN) {
+                s.stack_lift = true;
+                s.digit_entry = false;
+            }
+            if (s.returns.empty()) {
+                s.pc = 0;
+            } else {
+                s.pc = s.returns.back();
+                s.returns.pop_back();
+                if (s.pc > size + 1) {
+                    s.pc = size + 1;
+                }
+            }
+            lines++;
+            if (s.pc == 0) {
+                s.running = false;
+                goto done;
+            }
+            if (int(s.returns.size()) <= depth) {
+                goto done;
+            }
+            if (lines >= limit) {
+                goto done;
+            }
+            DISPATCH();
+
+        TARGET(NOP):
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(NUMBER):
+            // op_input() only clears the imaginary part when it lifts
+            if (s.stack_lift) {
+                push(s, numbers[insn->target]);
+            } else {
+                s.stack[0] = numbers[insn->target];
+            }
+            s.stack_lift = true;
+            s.digit_entry = true;
+            s.entry = entries[insn->target];
+            s.pc += insn->a;
+            NEXT(insn->a);
+
+        TARGET(ENTER):
+            s.stack_lift = true;
+            push(s, s.stack[0]);
+            s.stacki[0] = s.stacki[1];
+            s.stack_lift = false;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(CLX):
+            s.stack[0] = 0;
+            s.stack_lift = false;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(LASTX):
+            if (!s.lastx_known) {
+                FALL_BACK();
+            }
+            push(s, s.lastx);
+            s.stacki[0] = s.lastxi;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(ROLL):
+            x = s.stack[0]; s.stack[0] = s.stack[1]; s.stack[1] = s.stack[2]; s.stack[2] = s.stack[3]; s.stack[3] = x;
+            x = s.stacki[0]; s.stacki[0] = s.stacki[1]; s.stacki[1] = s.stacki[2]; s.stacki[2] = s.stacki[3]; s.stacki[3] = x;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(ROLLUP):
+            x = s.stack[3]; s.stack[3] = s.stack[2]; s.stack[2] = s.stack[1]; s.stack[1] = s.stack[0]; s.stack[0] = x;
+            x = s.stacki[3]; s.stacki[3] = s.stacki[2]; s.stacki[2] = s.stacki[1]; s.stacki[1] = s.stacki[0]; s.stacki[0] = x;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(XY):
+            x = s.stack[0]; s.stack[0] = s.stack[1]; s.stack[1] = x;
+            x = s.stacki[0]; s.stacki[0] = s.stacki[1]; s.stacki[1] = x;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(CHS):
+            s.stack[0] = -s.stack[0];
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(PI):
+            push(s, PI_VALUE);
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(ADD):
+        TARGET(SUB):
+        TARGET(MUL):
+        TARGET(DIV):
+        TARGET(POW):
+            switch (insn->op) {
+                case ADD: x = s.stack[1] + s.stack[0]; break;
+                case SUB: x = s.stack[1] - s.stack[0]; break;
+                case MUL: x = s.stack[1] * s.stack[0]; break;
+                case DIV: x = s.stack[1] / s.stack[0]; break;
+                default:  x = std::pow(s.stack[1], s.stack[0]); break;
+            }
+            if (!finite(x)) {
+                FALL_BACK();
+            }
+            s.lastx = s.stack[0];
+            s.lastxi = s.stacki[0];
+            s.lastx_known = true;
+            s.stack[0] = x;
+            drop(s);
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(SQRT):
+        TARGET(SQUARE):
+        TARGET(INV):
+        TARGET(ABS):
+        TARGET(EXP):
+        TARGET(LN):
+        TARGET(EXP10):
+        TARGET(LOG):
+        TARGET(INT):
+        TARGET(FRAC):
+            x = s.stack[0];
+            switch (insn->op) {
+                case SQRT:   x = std::sqrt(x); break;
+                case SQUARE: x = x * x; break;
+                case INV:    x = 1 / x; break;
+                case ABS:    x = std::fabs(x); break;
+                case EXP:    x = std::exp(x); break;
+                case LN:     x = std::log(x); break;
+                case EXP10:  x = std::pow(10.0, x); break;
+                case LOG:    x = std::log(x) / LN10; break;
+                case INT:    x = trunc(x); break;
+                default:     x = x - trunc(x); break;
+            }
+            if (!finite(x)) {
+                FALL_BACK();
+            }
+            s.lastx = s.stack[0];
+            s.lastxi = s.stacki[0];
+            s.lastx_known = true;
+            s.stack[0] = x;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(STO):
+            if (insn->a == IND) {
+                r = reg_index(s, IND);
+                if (r < 0) {
+                    FALL_BACK();
+                }
+            } else {
+                r = insn->a;
+            }
+            s.reg[r] = s.stack[0];
+            s.known[r] = true;
+            s.changed[r] = true;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(STO_OP):
+            r = reg_index(s, insn->a);
+            if (r < 0) {
+                FALL_BACK();
+            }
+            s.reg[r] = arith(insn->b, s.reg[r], s.stack[0]);
+            s.changed[r] = true;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(RCL):
+            r = reg_index(s, insn->a);
+            if (r < 0) {
+                FALL_BACK();
+            }
+            push(s, s.reg[r]);
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(RCL_OP):
+            r = reg_index(s, insn->a);
+            if (r < 0) {
+                FALL_BACK();
+            }
+            s.stack[0] = arith(insn->b, s.stack[0], s.reg[r]);
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(RCL_ARITH):
+            // RCL r then + - * or /. The RCL lifts the stack, so the
+            // arithmetic leaves Z in T as well.
+            r = reg_index(s, insn->a);
+            if (r < 0) {
+                FALL_BACK();
+            }
+            if (s.stack_lift) {
+                x = arith(insn->b, s.stack[0], s.reg[r]);
+                if (!finite(x)) {
+                    FALL_BACK();
+                }
+                s.stack[3] = s.stack[2]; s.stacki[3] = s.stacki[2];
+            } else {
+                x = arith(insn->b, s.stack[1], s.reg[r]);
+                if (!finite(x)) {
+                    FALL_BACK();
+                }
+                s.stack[1] = s.stack[2]; s.stacki[1] = s.stacki[2];
+                s.stack[2] = s.stack[3]; s.stacki[2] = s.stacki[3];
+            }
+            s.stack[0] = x;
+            s.stacki[0] = 0;
+            s.lastx = s.reg[r];
+            s.lastxi = 0;
+            s.lastx_known = true;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc += 2;
+            NEXT(2);
+
+        TARGET(DSE):
+        TARGET(ISG):
+            r = reg_index(s, insn->a);
+            if (r < 0 || !loop_counter(s, r, insn->op == ISG, skip)) {
+                FALL_BACK();
+            }
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc += skip ? 2 : 1;
+            NEXT(1);
+
+        TARGET(DSE_GTO):
+        TARGET(ISG_GTO):
+            r = reg_index(s, insn->a);
+            if (r < 0 || !loop_counter(s, r, insn->op == ISG_GTO, skip)) {
+                FALL_BACK();
+            }
+            s.stack_lift = true;
+            s.digit_entry = false;
+            if (skip) {
+                s.pc += 2;
+                NEXT(1);
+            }
+            s.pc = insn->target;
+            NEXT(2);
+
+        TARGET(GTO):
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc = insn->target;
+            NEXT(1);
+
+        TARGET(GSB):
+            s.returns.push_back(s.pc + 1);
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc = insn->target;
+            NEXT(1);
+
+        TARGET(TEST):
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc += test(s, insn->a) ? 1 : 2;
+            NEXT(1);
+
+        TARGET(TEST_GTO):
+            s.stack_lift = true;
+            s.digit_entry = false;
+            if (!test(s, insn->a)) {
+                s.pc += 2;
+                NEXT(1);
+            }
+            s.pc = insn->target;
+            NEXT(2);
+
+        TARGET(SF):
+        TARGET(CF):
+            s.flags[insn->a] = insn->op == SF;
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc++;
+            NEXT(1);
+
+        TARGET(FTEST):
+            s.stack_lift = true;
+            s.digit_entry = false;
+            s.pc += s.flags[insn->a] ? 1 : 2;
+            NEXT(1);
+
+        case OPS:
+            FALL_BACK();
+        }
+    }
+done:
+    return lines;
+}
+
+// Follows the lines from the label the way run() would, but keeps track of
+// which slot each stack register, LastX and each register holds instead of
+// the values themselves. Stack lift only depends on the lines, so it can be
+// worked out here once for every element. A register that is recalled
+// before it is stored to carries a value from one element to the next,
+// which the kernel cannot do, so such a subroutine is left to the script.
+bool Program::kernel(int pc, int label, Kernel &k) const
+{
+    int p = label_line(pc - 1, label);
+    if (p < 0) {
+        return false;
+    }
+    k.steps.clear();
+    k.stores.clear();
+
+    int stack[4] = {0, 0, 0, 0};
+    int lastx = -1;
+    int reg[REGS];
+    bool stored[REGS];
+    bool recalled[REGS];            // read from State before being stored to
+    for (int r = 0; r < REGS; r++) {
+        reg[r] = -1;
+        stored[r] = false;
+        recalled[r] = false;
+    }
+    bool lift = true;
+    int x, r;
+    for (;;) {
+        const Instr &i = code[p];
+        if (i.a == IND && (i.op == STO || i.op == STO_OP || i.op == RCL || i.op == RCL_OP || i.op == RCL_ARITH)) {
+            return false;
+        }
+        r = i.a;
+        switch (i.op) {
+            case END:
+            case RTN:
+                k.result = stack[0];
+                for (r = 0; r < REGS; r++) {
+                    if (stored[r] && recalled[r]) {
+                        return false;
+                    }
+                    if (stored[r]) {
+                        k.stores.push_back(r);
+                        k.stores.push_back(reg[r]);
+                    }
+                }
+                return true;
+
+            case NOP:
+                p++;
+                break;
+
+            case NUMBER:
+            case PI:
+                x = k.step(NUMBER, 0, 0);
+                k.steps[x - 1].k = i.op == PI ? PI_VALUE : numbers[i.target];
+                push_slot(stack, x, lift);
+                p += i.op == PI ? 1 : i.a;
+                break;
+
+            case ENTER:
+                push_slot(stack, stack[0], true);
+                p++;
+                lift = false;
+                continue;
+
+            case CLX:
+                stack[0] = k.step(NUMBER, 0, 0);
+                p++;
+                lift = false;
+                continue;
+
+            case LASTX:
+                if (lastx < 0) {
+                    return false;
+                }
+                push_slot(stack, lastx, lift);
+                p++;
+                break;
+
+            case ROLL:
+                x = stack[0]; stack[0] = stack[1]; stack[1] = stack[2]; stack[2] = stack[3]; stack[3] = x;
+                p++;
+                break;
+
+            case ROLLUP:
+                x = stack[3]; stack[3] = stack[2]; stack[2] = stack[1]; stack[1] = stack[0]; stack[0] = x;
+                p++;
+                break;
+
+            case XY:
+                x = stack[0]; stack[0] = stack[1]; stack[1] = x;
+                p++;
+                break;
+
+            case CHS:
+                stack[0] = k.step(CHS, stack[0], 0);
+                p++;
+                break;
+
+            case ADD:
+            case SUB:
+            case MUL:
+            case DIV:
+            case POW:
+                x = k.step(i.op, stack[0], stack[1]);
+                k.steps[x - 1].check = true;
+                lastx = stack[0];
+                stack[0] = x;
+                stack[1] = stack[2];
+                stack[2] = stack[3];
+                p++;
+                break;
+
+            case SQRT:
+            case SQUARE:
+            case INV:
+            case ABS:
+            case EXP:
+            case LN:
+            case EXP10:
+            case LOG:
+            case INT:
+            case FRAC:
+                x = k.step(i.op, stack[0], 0);
+                k.steps[x - 1].check = true;
+                lastx = stack[0];
+                stack[0] = x;
+                p++;
+                break;
+
+            case STO:
+                reg[r] = stack[0];
+                stored[r] = true;
+                p++;
+                break;
+
+            case STO_OP:
+            case RCL:
+            case RCL_OP:
+            case RCL_ARITH:
+                if (reg[r] < 0) {
+                    reg[r] = k.step(RCL, 0, 0);
+                    k.steps[reg[r] - 1].a = r;
+                    recalled[r] = true;
+                }
+                if (i.op == STO_OP) {
+                    reg[r] = k.step(arith_op(i.b), stack[0], reg[r]);
+                    stored[r] = true;
+                    p++;
+                } else if (i.op == RCL) {
+                    push_slot(stack, reg[r], lift);
+                    p++;
+                } else if (i.op == RCL_OP) {
+                    stack[0] = k.step(arith_op(i.b), reg[r], stack[0]);
+                    p++;
+                } else {
+                    // as run() does it, with LastX set to the register
+                    if (lift) {
+                        x = k.step(arith_op(i.b), reg[r], stack[0]);
+                        stack[3] = stack[2];
+                    } else {
+                        x = k.step(arith_op(i.b), reg[r], stack[1]);
+                        stack[1] = stack[2];
+                        stack[2] = stack[3];
+                    }
+                    k.steps[x - 1].check = true;
+                    stack[0] = x;
+                    lastx = reg[r];
+                    p += 2;
+                }
+                break;
+
+            default:
+                return false;
+        }
+        lift = true;
+    }
+}
+
+Kernel::Kernel()
+    : result(0)
+{
+}
+
+int Kernel::step(int op, int x, int y)
+{
+    Step s = Step();
+    s.op = op;
+    s.x = x;
+    s.y = y;
+    steps.push_back(s);
+    return int(steps.size());
+}
+
+bool Kernel::map(std::vector<double> &values, State &s) const
+{
+    size_t n = values.size();
+    if (n == 0) {
+        return true;
+    }
+    std::vector<std::vector<double> > slots(steps.size() + 1);
+    slots[0] = values;
+    for (size_t i = 0; i < steps.size(); i++) {
+        const Step &t = steps[i];
+        slots[i + 1].resize(n);
+        double *r = &slots[i + 1][0];
+        const double *x = &slots[t.x][0];
+        const double *y = &slots[t.y][0];
+        size_t j;
+        switch (t.op) {
+            case NUMBER:
+                for (j = 0; j < n; j++) r[j] = t.k;
+                break;
+            case RCL:
+                if (!s.known[t.a]) {
+                    return false;
+                }
+                for (j = 0; j < n; j++) r[j] = s.reg[t.a];
+                break;
+            case CHS:    for (j = 0; j < n; j++) r[j] = -x[j]; break;
+            case ADD:    for (j = 0; j < n; j++) r[j] = y[j] + x[j]; break;
+            case SUB:    for (j = 0; j < n; j++) r[j] = y[j] - x[j]; break;
+            case MUL:    for (j = 0; j < n; j++) r[j] = y[j] * x[j]; break;
+            case DIV:    for (j = 0; j < n; j++) r[j] = y[j] / x[j]; break;
+            case POW:    for (j = 0; j < n; j++) r[j] = std::pow(y[j], x[j]); break;
+            case SQRT:   for (j = 0; j < n; j++) r[j] = std::sqrt(x[j]); break;
+            case SQUARE: for (j = 0; j < n; j++) r[j] = x[j] * x[j]; break;
+            case INV:    for (j = 0; j < n; j++) r[j] = 1 / x[j]; break;
+            case ABS:    for (j = 0; j < n; j++) r[j] = std::fabs(x[j]); break;
+            case EXP:    for (j = 0; j < n; j++) r[j] = std::exp(x[j]); break;
+            case LN:     for (j = 0; j < n; j++) r[j] = std::log(x[j]); break;
+            case EXP10:  for (j = 0; j < n; j++) r[j] = std::pow(10.0, x[j]); break;
+            case LOG:    for (j = 0; j < n; j++) r[j] = std::log(x[j]) / LN10; break;
+            case INT:    for (j = 0; j < n; j++) r[j] = trunc(x[j]); break;
+            case FRAC:   for (j = 0; j < n; j++) r[j] = x[j] - trunc(x[j]); break;
+        }
+        if (t.check && !all_finite(r, n)) {
+            return false;
+        }
+    }
+
+    values = slots[result];
+    for (size_t i = 0; i < stores.size(); i += 2) {
+        int r = stores[i];
+        s.reg[r] = slots[stores[i + 1]][n - 1];
+        s.known[r] = true;
+        s.changed[r] = true;
+    }
+    return true;
+}
+
+} // namespace vm
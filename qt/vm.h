@@ -0,0 +1,126 @@
+#ifndef VM_H
+#define VM_H
+
+#include <string>            // for string
+#include <vector>            // for vector
+
+// A virtual machine for stored programs. The keycodes of each program line
+// are translated into bytecode, with common pairs of lines fused into a
+// single instruction, and run against a copy of the calculator state taken
+// from hp15c.js. A line the machine cannot run is left for step() in
+// hp15c.js, after which the machine can carry on from the next line.
+
+namespace vm {
+
+// Register I is kept after the 60 numbered registers.
+const int REG_I = 60;
+const int REGS = 61;
+
+// Flags 8 (complex mode) and 9 (overflow) are left to the script.
+const int FLAGS = 8;
+
+struct State {
+    double stack[4];
+    double stacki[4];
+    double lastx;
+    double lastxi;
+    bool lastx_known;        // false when LastX is not a number
+    double reg[REGS];
+    bool known[REGS];        // false when the register is not a number
+    bool changed[REGS];
+    bool flags[FLAGS];
+    bool stack_lift;
+    bool digit_entry;
+    std::string entry;
+    std::vector<int> returns;
+    int pc;
+    bool running;
+};
+
+// A subroutine without branches, compiled by Program::kernel() so that it
+// can be evaluated for a whole array of values of X at once, as
+// op_matrix_map() in hp15c.js calls it for each element of a matrix. Each
+// step is done for every element before the next one starts, in loops
+// simple enough for the compiler to vectorize.
+class Kernel {
+public:
+    Kernel();
+
+    // Replace each x in values with what the subroutine leaves in X when
+    // it is called with x in every stack register. The registers it recalls
+    // are taken from s, and the ones it stores to are left in s as the
+    // last element leaves them. Returns false, with values and s unchanged,
+    // when a register it recalls is not a number or a step has a result
+    // that the script would stop on with an error.
+    bool map(std::vector<double> &values, State &s) const;
+
+private:
+    friend class Program;
+
+    struct Step {
+        unsigned char op;
+        unsigned char a;     // register
+        bool check;          // whether the result must be finite
+        int x;               // operand slots, where slot 0 holds the values
+        int y;
+        double k;            // constant
+    };
+
+    int step(int op, int x, int y);
+
+    std::vector<Step> steps;        // steps[i] fills slot i+1
+    std::vector<int> stores;        // register and slot pairs
+    int result;
+};
+
+class Program {
+public:
+    Program();
+
+    // Translate a program. lines[i] holds the keys of program line i+1, or
+    // is empty for a line that must be left to the script.
+    void load(const std::vector<std::vector<int> > &lines);
+
+    // Whether it is worth calling run() at line pc: the line can be run,
+    // and enough lines after it can be too to pay for copying the state.
+    bool runs(int pc) const;
+
+    // The registers the program uses, which is all of them when it uses
+    // (i). Only these need to be copied into State::reg.
+    const std::vector<int> &registers() const;
+
+    // Run lines from s.pc until a line that is left to the script, a
+    // return that leaves depth or fewer entries on the return stack, the
+    // end of the program or limit lines. Returns the number of lines run.
+    int run(State &s, int depth, int limit) const;
+
+    // Compile the subroutine that op_gsb(label) would call with PC at pc
+    // into k. Returns false when it branches, tests, calls, uses flags or
+    // (i), or has a line that is left to the script.
+    bool kernel(int pc, int label, Kernel &k) const;
+
+private:
+    struct Instr {
+        unsigned char op;
+        unsigned char a;     // register, flag or test number
+        unsigned char b;     // arithmetic operator
+        int target;          // line to jump to, or index into numbers
+    };
+
+    int label_line(int line, int label) const;
+    Instr translate(int line) const;
+    int translate_number(int line);
+    void fuse(int line);
+
+    int size;
+    std::vector<std::vector<int> > keys;
+    std::vector<Instr> code;        // code[p] is the instruction for line p
+    std::vector<int> stretch;       // lines that run from line p before the script is needed
+    std::vector<double> numbers;
+    std::vector<std::string> entries;
+    std::vector<int> regs;
+};
+
+} // namespace vm
+
+#endif // VM_H